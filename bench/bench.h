@@ -0,0 +1,55 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+
+#include "mock-hal.h"
+
+//
+// Shared helpers for the host benchmarks.
+//
+
+namespace Bench {
+
+  // Wall clock timer, started on construction.
+  class Timer {
+    public:
+      inline Timer() : start(std::chrono::steady_clock::now()) {}
+
+      inline double elapsedNs() const {
+        std::chrono::duration<double, std::nano> elapsed =
+            std::chrono::steady_clock::now() - this->start;
+        return elapsed.count();
+      }
+
+    private:
+      std::chrono::steady_clock::time_point start;
+  };
+
+  // Keep the optimizer from discarding a benchmarked result.
+  template<typename T>
+  inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+  }
+}
+
+#endif
@@ -0,0 +1,167 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+//
+// Benchmark for the fixed point color math in color.h, against the float
+// implementation it replaced.
+//
+//   color-bench [pixels]
+//
+
+#include <stdio.h>
+
+#include "bench.h"
+#include "particle-strip.h"
+
+namespace {
+
+  // The original float mixColor, for comparison.
+  Color mixColorFloat(Color left, Color right, float ratio) {
+    if (ratio < 0.0)
+      ratio = 0.0;
+
+    if (ratio > 1.0)
+      ratio = 1.0;
+
+    float l_ratio = 1.0 - ratio;
+    float r_ratio = ratio;
+
+    Color result;
+
+    result.special = 0;
+    result.red = (left.red * l_ratio) + (right.red * r_ratio);
+    result.green = (left.green * l_ratio) + (right.green * r_ratio);
+    result.blue = (left.blue * l_ratio) + (right.blue * r_ratio);
+
+    return result;
+  }
+
+  const int PASSES = 200;
+
+  void report(const char* name, double ns, int pixels) {
+    printf("%-28s %10.3f ns/pixel\n", name, ns / PASSES / pixels);
+  }
+}
+
+int main(int argc, char** argv) {
+  int pixels = argc > 1 ? atoi(argv[1]) : 10000;
+
+  MockHal::reset();
+
+  Color* left = (Color*)malloc(sizeof(Color) * pixels);
+  Color* right = (Color*)malloc(sizeof(Color) * pixels);
+  Color* result = (Color*)malloc(sizeof(Color) * pixels);
+
+  for (int i = 0; i < pixels; i++) {
+    left[i] = randomColor();
+    right[i] = randomColor();
+  }
+
+  // Mixing, per pixel with the ratio varying per pass.
+  {
+    Bench::Timer timer;
+    for (int pass = 0; pass < PASSES; pass++) {
+      float ratio = pass / (float)PASSES;
+      for (int i = 0; i < pixels; i++)
+        result[i] = mixColorFloat(left[i], right[i], ratio);
+      Bench::doNotOptimize(result);
+    }
+    report("mixColor (float)", timer.elapsedNs(), pixels);
+  }
+
+  {
+    Bench::Timer timer;
+    for (int pass = 0; pass < PASSES; pass++) {
+      ColorRatio ratio = pass * RATIO_ONE / PASSES;
+      for (int i = 0; i < pixels; i++)
+        result[i] = lerpColor(left[i], right[i], ratio);
+      Bench::doNotOptimize(result);
+    }
+    report("lerpColor (8.8)", timer.elapsedNs(), pixels);
+  }
+
+  {
+    Bench::Timer timer;
+    for (int pass = 0; pass < PASSES; pass++) {
+      ColorRatio ratio = pass * RATIO_ONE / PASSES;
+      mixBuffer(result, left, right, pixels, ratio);
+      Bench::doNotOptimize(result);
+    }
+    report("mixBuffer (8.8 SWAR)", timer.elapsedNs(), pixels);
+  }
+
+  // Dimming in place.
+  {
+    Bench::Timer timer;
+    for (int pass = 0; pass < PASSES; pass++) {
+      for (int i = 0; i < pixels; i++)
+        result[i] = mixColorFloat(BLACK, left[i], 0.75);
+      Bench::doNotOptimize(result);
+    }
+    report("dim (float)", timer.elapsedNs(), pixels);
+  }
+
+  {
+    Bench::Timer timer;
+    for (int pass = 0; pass < PASSES; pass++) {
+      for (int i = 0; i < pixels; i++)
+        result[i] = scaleColor(left[i], 192);
+      Bench::doNotOptimize(result);
+    }
+    report("scaleColor (8.8)", timer.elapsedNs(), pixels);
+  }
+
+  {
+    Bench::Timer timer;
+    for (int pass = 0; pass < PASSES; pass++) {
+      memcpy(result, left, sizeof(Color) * pixels);
+      scaleBuffer(result, pixels, 192);
+      Bench::doNotOptimize(result);
+    }
+    report("scaleBuffer (8.8 SWAR)", timer.elapsedNs(), pixels);
+  }
+
+  // The fixed point versions must agree with each other exactly, and with
+  // the float version to within its truncation.
+  int worst = 0;
+  for (int ratio = 0; ratio <= RATIO_ONE; ratio++) {
+    mixBuffer(result, left, right, pixels, ratio);
+
+    for (int i = 0; i < pixels; i++) {
+      Color fixed = lerpColor(left[i], right[i], ratio);
+      Color reference = mixColorFloat(left[i], right[i], ratio / 256.0);
+
+      if (fixed != result[i]) {
+        printf("mixBuffer mismatch at ratio %d\n", ratio);
+        return 1;
+      }
+
+      int error = abs(fixed.red - reference.red);
+      if (error > worst)
+        worst = error;
+    }
+  }
+  printf("largest difference from float: %d\n", worst);
+
+  free(left);
+  free(right);
+  free(result);
+
+  return 0;
+}
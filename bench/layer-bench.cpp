@@ -0,0 +1,397 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+//
+// Checks and benchmarks for layered drawing (compositor.h).
+//
+// The word blend kernels are checked against per channel arithmetic, for
+// random colors and every pair of shades. Layers of random pixels, blend
+// modes and opacities are composited, and checked against the same blends
+// done a channel at a time. An animated compositor is checked to send the
+// strip no more often than its frame rate allows, and to keep the strip's
+// power estimate right under a budget. Calls on missing layers or patterns
+// are checked to be refused. Then compositing is timed
+// for each blend mode and number of layers. Exits non zero if any check
+// fails.
+//
+//   layer-bench [frames]
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "particle-strip.h"
+
+namespace {
+
+  const BlendMode MODES[] = {
+    BLEND_OVER, BLEND_ADD, BLEND_MULTIPLY, BLEND_MAX
+  };
+
+  const char* MODE_LABELS[] = { "over", "add", "multiply", "max" };
+
+  uint8_t addShade(uint8_t left, uint8_t right) {
+    return left + right > 255 ? 255 : left + right;
+  }
+
+  uint8_t maxShade(uint8_t left, uint8_t right) {
+    return left > right ? left : right;
+  }
+
+  uint32_t word(Color color) {
+    uint32_t result;
+    memcpy(&result, &color, sizeof(result));
+    return result;
+  }
+
+  Color color(uint32_t word) {
+    Color result;
+    memcpy(&result, &word, sizeof(result));
+    return result;
+  }
+
+  // The blend of top over bottom, a channel at a time.
+  Color blendColor(Color bottom, Color top, BlendMode mode,
+                   ColorRatio opacity) {
+    Color blended = bottom;
+    top.special = 0;
+
+    switch (mode) {
+      case BLEND_OVER:
+        if (top != BLACK)
+          blended = top;
+        break;
+      case BLEND_ADD:
+        blended.red = addShade(bottom.red, top.red);
+        blended.green = addShade(bottom.green, top.green);
+        blended.blue = addShade(bottom.blue, top.blue);
+        break;
+      case BLEND_MULTIPLY:
+        blended.red = multiplyShade(bottom.red, top.red);
+        blended.green = multiplyShade(bottom.green, top.green);
+        blended.blue = multiplyShade(bottom.blue, top.blue);
+        break;
+      case BLEND_MAX:
+        blended.red = maxShade(bottom.red, top.red);
+        blended.green = maxShade(bottom.green, top.green);
+        blended.blue = maxShade(bottom.blue, top.blue);
+        break;
+    }
+
+    return lerpColor(bottom, blended, opacity);
+  }
+
+  // Channels of a kernel result, against the expected shades.
+  bool matches(uint32_t result, uint8_t red, uint8_t green, uint8_t blue) {
+    Color c = color(result);
+    return c.red == red && c.green == green && c.blue == blue;
+  }
+
+  int checkKernels() {
+    int failures = 0;
+
+    for (long n = 0; n < 1000000; n++) {
+      Color l, r;
+      if (n < 65536) {
+        // Every pair of shades, in all three channels.
+        l = Color{(uint8_t)n, (uint8_t)(n >> 8), (uint8_t)n, (uint8_t)(n >> 8)};
+        r = Color{(uint8_t)(n >> 8), (uint8_t)n, (uint8_t)(n >> 8), (uint8_t)n};
+      } else {
+        l = Color{(uint8_t)random(256), (uint8_t)random(256),
+                  (uint8_t)random(256), (uint8_t)random(256)};
+        r = Color{(uint8_t)random(256), (uint8_t)random(256),
+                  (uint8_t)random(256), (uint8_t)random(256)};
+      }
+
+      uint32_t lw = word(l);
+      uint32_t rw = word(r);
+
+      if (!matches(_addWord(lw, rw), addShade(l.red, r.red),
+                   addShade(l.green, r.green), addShade(l.blue, r.blue)) ||
+          !matches(_maxWord(lw, rw), maxShade(l.red, r.red),
+                   maxShade(l.green, r.green), maxShade(l.blue, r.blue)) ||
+          !matches(_multiplyWord(lw, rw), multiplyShade(l.red, r.red),
+                   multiplyShade(l.green, r.green),
+                   multiplyShade(l.blue, r.blue))) {
+        if (failures++ < 10)
+          printf("kernels: wrong for %02x%02x%02x, %02x%02x%02x\n",
+                 l.red, l.green, l.blue, r.red, r.green, r.blue);
+      }
+    }
+
+    // Multiply is exact at the ends, and rounds to the nearest shade.
+    for (int a = 0; a < 256; a++) {
+      for (int b = 0; b < 256; b++) {
+        int expected = (a * b * 2 + 255) / 510;
+        if (multiplyShade(a, b) != expected && failures++ < 10)
+          printf("kernels: multiply %d * %d = %d, expected %d\n",
+                 a, b, multiplyShade(a, b), expected);
+      }
+    }
+
+    return failures;
+  }
+
+  // Draw random frames into layers of random modes and opacities, and check
+  // the strip against blendColor.
+  template<typename StripT>
+  int checkComposite(const char* label, StripT* strip) {
+    int failures = 0;
+    int pixelCount = strip->getPixelCount();
+
+    for (int round = 0; round < 200; round++) {
+      BasicCompositor<StripT> compositor(strip);
+      int layerCount = 1 + random(COMPOSITOR_MAX_LAYERS);
+
+      for (int l = 0; l < layerCount; l++) {
+        BlendMode mode = MODES[random(4)];
+        int layer = compositor.addLayer(mode, false);
+        if (random(2))
+          compositor.setLayerOpacity(layer, random(RATIO_ONE + 1));
+
+        FrameStrip* canvas = compositor.getCanvas(layer);
+        for (int i = 0; i < pixelCount; i++) {
+          canvas->setPixel(i, random(4) ? randomColor() : BLACK);
+        }
+        canvas->finishDraw();
+      }
+
+      // A layer past the limit.
+      if (layerCount == COMPOSITOR_MAX_LAYERS && compositor.addLayer() != -1) {
+        printf("%s: added too many layers\n", label);
+        failures++;
+      }
+
+      compositor.drawUpdate();
+
+      for (int i = 0; i < pixelCount; i++) {
+        Color expected = BLACK;
+        for (int l = 0; l < layerCount; l++) {
+          expected = blendColor(expected,
+                                compositor.getCanvas(l)->getPixel(i),
+                                compositor.getLayerMode(l),
+                                compositor.getLayerOpacity(l));
+        }
+
+        if (strip->getPixel(i) != expected) {
+          if (failures++ < 10)
+            printf("%s: pixel %d of %d layers\n", label, i, layerCount);
+          break;
+        }
+      }
+    }
+
+    return failures;
+  }
+
+  // LAVA, CYLON and a status pixel, for 10s.
+  int checkFrameRate() {
+    MockHal::reset();
+
+    DotStrip strip(60);
+    Compositor compositor(&strip);
+
+    int background = compositor.addLayer();
+    int eye = compositor.addLayer(BLEND_ADD);
+    int status = compositor.addLayer(BLEND_OVER, false);
+
+    compositor.setPattern(background, LAVA, RED, BLACK, 400);
+    compositor.setPattern(eye, CYLON, BLUE, BLACK, 500);
+    compositor.getCanvas(status)->setPixel(0, GREEN);
+    compositor.getCanvas(status)->finishDraw();
+
+    unsigned long long start = MockHal::counters().spiTransfers;
+    for (int i = 0; i < 10000; i++) {
+      compositor.drawUpdate();
+      MockHal::advanceMillis(1);
+    }
+    unsigned long long transfers = MockHal::counters().spiTransfers - start;
+
+    printf("layers: 3 layers on 60 pixels, %llu frames sent in 10s\n",
+           transfers);
+
+    if (transfers > 10 * DEFAULT_MAX_FRAME_RATE + 1 || transfers < 100 ||
+        strip.getPixel(0) != GREEN) {
+      printf("layers: sent %llu frames, pixel 0 %s\n", transfers,
+             strip.getPixel(0) == GREEN ? "GREEN" : "not GREEN");
+      return 1;
+    }
+    return 0;
+  }
+
+  // SOLID WHITE with CYLON half over it on 100 pixels, with a 1000mA budget,
+  // which is well under what the pixels would draw unlimited. The
+  // strip's estimate must stay within the budget, and match a strip that
+  // recounts every pixel.
+  int checkPower() {
+    const int PIXELS = 100;
+    const int BUDGET = 1000;
+
+    MockHal::reset();
+
+    DotStrip strip(PIXELS);
+    DotStrip recount(PIXELS);
+    strip.setPowerBudget(BUDGET);
+    recount.setPowerBudget(BUDGET);
+
+    Compositor compositor(&strip);
+    compositor.setPattern(compositor.addLayer(), SOLID, WHITE, BLACK, 1000);
+    int eye = compositor.addLayer(BLEND_MULTIPLY);
+    compositor.setPattern(eye, CYLON, RED, BLACK, 500);
+    compositor.setLayerOpacity(eye, RATIO_ONE / 2);
+
+    for (int i = 0; i < 2000; i++) {
+      compositor.drawUpdate();
+      MockHal::advanceMillis(1);
+
+      // Writes through getPixelBuffer() make the strip recount.
+      memcpy(recount.getPixelBuffer(), strip.readPixelBuffer(),
+             PIXELS * sizeof(Color));
+      recount.finishDraw();
+
+      int milliamps = strip.getEstimatedMilliamps();
+      if (milliamps > BUDGET ||
+          milliamps != recount.getEstimatedMilliamps()) {
+        printf("power: %dms estimated %dmA, recounted %dmA\n", i,
+               milliamps, recount.getEstimatedMilliamps());
+        return 1;
+      }
+    }
+
+    if (strip.getEstimatedMilliamps() < BUDGET * 9 / 10) {
+      printf("power: estimated %dmA\n", strip.getEstimatedMilliamps());
+      return 1;
+    }
+    return 0;
+  }
+
+  // Calls on layers that don't exist, and pattern calls on a canvas layer.
+  int checkMissingLayers() {
+    MockHal::reset();
+
+    DotStrip strip(10);
+    Compositor compositor(&strip);
+
+    int canvas = compositor.addLayer(BLEND_OVER, false);
+    int failed = -1;
+    for (int l = 0; l <= COMPOSITOR_MAX_LAYERS; l++) {
+      failed = compositor.addLayer();
+    }
+
+    PatternDescription none;
+    int failures = 0;
+    if (failed != -1 ||
+        compositor.getLayerCount() != COMPOSITOR_MAX_LAYERS ||
+        compositor.setPattern(canvas, CYLON, RED, BLUE, 100) ||
+        compositor.getPattern(canvas).pattern != none.pattern ||
+        compositor.getLayerPattern(canvas) ||
+        compositor.setPattern(failed, CYLON, RED, BLUE, 100) ||
+        compositor.getPattern(failed).pattern != none.pattern ||
+        compositor.setLayerMode(failed, BLEND_ADD) ||
+        compositor.setLayerOpacity(COMPOSITOR_MAX_LAYERS, 0) ||
+        compositor.getCanvas(failed) ||
+        compositor.getCanvas(COMPOSITOR_MAX_LAYERS) ||
+        !compositor.setPattern(canvas + 1, CYLON, RED, BLUE, 100)) {
+      printf("layers: missing layers or patterns were not refused\n");
+      failures++;
+    }
+
+    // The animated layer switches on its next update.
+    compositor.drawUpdate();
+    if (compositor.getPattern(canvas + 1).pattern != CYLON) {
+      printf("layers: pattern not set on an animated layer\n");
+      failures++;
+    }
+    return failures;
+  }
+
+  void timeComposite(const char* label, int layerCount, BlendMode mode,
+                     int pixelCount, int frames) {
+    MockHal::reset();
+
+    // No frame rate limit, so every call composites.
+    FrameStrip strip(pixelCount);
+    strip.setMaxFrameRate(0);
+    BasicCompositor<FrameStrip> compositor(&strip);
+
+    for (int l = 0; l < layerCount; l++) {
+      int layer = compositor.addLayer(l ? mode : BLEND_OVER, false);
+      FrameStrip* canvas = compositor.getCanvas(layer);
+      for (int i = 0; i < pixelCount; i++) {
+        canvas->setPixel(i, randomColor());
+      }
+    }
+
+    Bench::Timer timer;
+    for (int f = 0; f < frames; f++) {
+      compositor.getCanvas(0)->finishDraw();
+      compositor.drawUpdate();
+    }
+    double ns = timer.elapsedNs();
+
+    printf("%-10s %6d %6d %12.1f %10.2f\n", label, layerCount, pixelCount,
+           ns / frames, ns / frames / pixelCount);
+  }
+
+  void timing(int frames) {
+    const int PIXEL_COUNTS[] = { 60, 300, 1000 };
+
+    printf("\n%-10s %6s %6s %12s %10s\n",
+           "mode", "layers", "pixels", "ns/frame", "ns/pixel");
+
+    for (size_t m = 0; m < sizeof(MODES) / sizeof(MODES[0]); m++) {
+      for (int layers = 2; layers <= COMPOSITOR_MAX_LAYERS; layers++) {
+        for (size_t c = 0;
+             c < sizeof(PIXEL_COUNTS) / sizeof(PIXEL_COUNTS[0]); c++) {
+          timeComposite(MODE_LABELS[m], layers, MODES[m], PIXEL_COUNTS[c],
+                        frames);
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  int frames = argc > 1 ? atoi(argv[1]) : 2000;
+
+  int failures = checkKernels();
+  printf("kernels: %d failures\n", failures);
+
+  MockHal::reset();
+  {
+    DotStrip strip(37);
+    failures += checkComposite("dot", &strip);
+  }
+
+  MockHal::reset();
+  {
+    DotStrip strip(37, false, PIXEL_RGB888);
+    failures += checkComposite("dot-rgb888", &strip);
+  }
+
+  failures += checkFrameRate();
+  failures += checkMissingLayers();
+  failures += checkPower();
+  printf("layers: %d failures\n", failures);
+
+  timing(frames);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,486 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+//
+// Frame level benchmark for every Pattern handler, on every strip type.
+//
+// Each pattern is run against each strip backend over a sweep of pixel counts,
+// reporting wall clock cost per drawUpdate() and the bytes the strip emitted.
+// The virtual clock is advanced to each frame's deadline, so every call draws
+// a frame.
+//
+// The "-static" strip types draw through BasicPattern<StripT> on the concrete
+// strip type, instead of Pattern through ColorStrip, to compare the cost of
+// virtual calls.
+//
+// First, fillRange() and copyRange() are checked on random ranges, partly off
+// the strip and overlapping, against the same changes made a pixel at a time.
+// LAVA is also drawn with no blobs, and more blobs than are kept inline, and
+// palette strips are checked to resend and recount when the palette changes.
+// TEST runs on a strip whose cycle outlasts micros(), and SOLID at a speed
+// too long to count in us.
+// Exits non zero if a check fails.
+//
+//   pattern-bench [max_pixels] [strip] [pattern]
+//
+// Optional filters limit the sweep, eg: "pattern-bench 1000 dot LAVA".
+//
+
+#include <stdio.h>
+
+#include "bench.h"
+#include "particle-strip.h"
+
+namespace {
+
+  const int PIXEL_COUNTS[] = { 1, 10, 100, 300, 1000, 10000 };
+
+  // Aim for roughly this many pixels drawn per measurement.
+  const long PIXEL_BUDGET = 4000000;
+
+  struct PatternCase {
+    PatternType pattern;
+    int speed;
+  };
+
+  const PatternCase PATTERNS[] = {
+    { SOLID, 1000 },
+    { PULSE, 1000 },
+    { CYLON, 1000 },
+    { ALTERNATE, 500 },
+    { FLICKER, 200 },
+    { LAVA, 200 },
+    { TEST, 300 },
+  };
+
+  const char* PATTERN_LABELS[] = {
+    "SOLID", "PULSE", "CYLON", "ALTERNATE", "FLICKER", "LAVA", "TEST"
+  };
+
+  typedef enum {
+    DIGITAL,
+    DIGITAL_ASYNC,
+    DOT,
+    DOT_ASYNC,
+    DOT_HDR,
+    DOT_RGB888,
+    DOT_RGB565,
+    DOT_PALETTE8,
+    DOT_PALETTE4,
+    NEO,
+    NEO_WIRE,
+    LED,
+    DIGITAL_STATIC,
+    DOT_STATIC,
+    NEO_STATIC,
+    STRIP_TYPE_COUNT,
+  } StripType;
+
+  const char* STRIP_LABELS[] = {
+    "digital", "digital-async", "dot", "dot-async", "dot-hdr", "dot-rgb888",
+    "dot-rgb565", "dot-pal8", "dot-pal4", "neo", "neo-wire", "led",
+    "digital-static", "dot-static", "neo-static"
+  };
+
+  ColorStrip* createStrip(StripType type, int pixelCount) {
+    switch (type) {
+      case DIGITAL:
+      case DIGITAL_STATIC:
+        return new DigitalStrip(pixelCount);
+      case DIGITAL_ASYNC:
+        return new DigitalStrip(pixelCount, true);
+      case DOT:
+      case DOT_STATIC:
+        return new DotStrip(pixelCount);
+      case DOT_ASYNC:
+        return new DotStrip(pixelCount, true);
+      case DOT_HDR: {
+        DotStrip* strip = new DotStrip(pixelCount);
+        strip->setGamma(true);
+        strip->setHdr(true);
+        return strip;
+      }
+      case DOT_RGB888:
+        return new DotStrip(pixelCount, false, PIXEL_RGB888);
+      case DOT_RGB565:
+        return new DotStrip(pixelCount, false, PIXEL_RGB565);
+      case DOT_PALETTE8:
+      case DOT_PALETTE4: {
+        // A palette per case, so each starts empty.
+        static ColorPalette palette;
+        palette = ColorPalette();
+        DotStrip* strip = new DotStrip(
+            pixelCount, false,
+            type == DOT_PALETTE8 ? PIXEL_PALETTE8 : PIXEL_PALETTE4);
+        strip->setPalette(&palette);
+        return strip;
+      }
+      case NEO:
+      case NEO_STATIC:
+        return new NeoStrip(pixelCount, D2);
+      case NEO_WIRE:
+        return new NeoStrip(pixelCount, D2, WS2812B, PIXEL_WIRE);
+      case LED:
+      case STRIP_TYPE_COUNT:
+        break;
+    }
+    return new LedStrip(D0, D1, D2);
+  }
+
+  unsigned long long emittedBytes() {
+    const MockHal::Counters& counters = MockHal::counters();
+    return (counters.spiBytes +
+            counters.neoPixelBytes +
+            counters.analogWrites);
+  }
+
+  template<typename PatternT>
+  void advanceToNextDraw(PatternT& pattern) {
+    MockHal::advanceMicros((system_tick_t)(pattern.getNextDraw() - micros()));
+  }
+
+  // Random fills and copies, in one frame buffer format.
+  int checkRanges(const char* label, PixelFormat format) {
+    const int PIXELS = 37;
+    int failures = 0;
+
+    MockHal::reset();
+
+    DotStrip strip(PIXELS, false, format);
+    DotStrip reference(PIXELS, false, format);
+
+    for (int op = 0; op < 2000 && !failures; op++) {
+      int count = random(-2, PIXELS + 5);
+      int to = random(-PIXELS / 2, PIXELS + 5);
+
+      if (op % 2) {
+        Color color = randomColor();
+        strip.fillRange(to, count, color);
+
+        for (int i = to; i < to + count; i++) {
+          if (i >= 0 && i < PIXELS)
+            reference.setPixel(i, color);
+        }
+      } else {
+        int from = random(-PIXELS / 2, PIXELS + 5);
+        strip.copyRange(to, from, count);
+
+        Color before[PIXELS];
+        for (int i = 0; i < PIXELS; i++) {
+          before[i] = reference.getPixel(i);
+        }
+        for (int i = 0; i < count; i++) {
+          if (from + i >= 0 && from + i < PIXELS &&
+              to + i >= 0 && to + i < PIXELS) {
+            reference.setPixel(to + i, before[from + i]);
+          }
+        }
+      }
+
+      for (int i = 0; i < PIXELS; i++) {
+        if (strip.getPixel(i) != reference.getPixel(i)) {
+          printf("%s: %s %d pixels at %d, pixel %d differs\n", label,
+                 op % 2 ? "fill" : "copy", count, to, i);
+          failures++;
+          break;
+        }
+      }
+
+      if (strip.getEstimatedMilliamps() != reference.getEstimatedMilliamps()) {
+        printf("%s: estimated %dmA, expected %dmA\n", label,
+               strip.getEstimatedMilliamps(),
+               reference.getEstimatedMilliamps());
+        failures++;
+      }
+    }
+
+    return failures;
+  }
+
+  // LAVA with a few blob counts, including bad ones.
+  int checkBlobCounts() {
+    const int COUNTS[] = { 0, BLOB_COUNT, 40, -1, 1 };
+    int failures = 0;
+
+    MockHal::reset();
+
+    DotStrip strip(60);
+    BasicPattern<DotStrip> pattern(&strip);
+    pattern.setPattern(LAVA, RED, BLUE, 200);
+
+    for (unsigned n = 0; n < sizeof(COUNTS) / sizeof(COUNTS[0]); n++) {
+      int count = COUNTS[n];
+      int expected = count < 0 ? pattern.getBlobCount() : count;
+
+      if (pattern.setBlobCount(count) != (count >= 0) ||
+          pattern.getBlobCount() != expected) {
+        printf("blobs: setBlobCount(%d) left %d blobs\n", count,
+               pattern.getBlobCount());
+        failures++;
+      }
+
+      for (int i = 0; i < 100; i++) {
+        pattern.drawUpdate();
+        advanceToNextDraw(pattern);
+      }
+    }
+
+    return failures;
+  }
+
+  // Palette changes under a drawn frame, with a PIXEL_COLOR strip drawn the
+  // same way for reference.
+  int checkPalette() {
+    const int PIXELS = 20;
+    int failures = 0;
+
+    MockHal::reset();
+
+    ColorPalette palette;
+    DotStrip strip(PIXELS, false, PIXEL_PALETTE8);
+    DotStrip reference(PIXELS);
+    strip.setPalette(&palette);
+    strip.setPowerBudget(1000);
+    reference.setPowerBudget(1000);
+
+    strip.drawSolid(RED);
+    reference.drawSolid(RED);
+
+    struct Step {
+      const char* label;
+      Color color;
+      bool change;
+    };
+
+    const Step STEPS[] = {
+      { "same", RED, false },
+      { "set", BLUE, true },
+      { "clear", BLACK, true },
+    };
+
+    for (unsigned n = 0; n < sizeof(STEPS) / sizeof(STEPS[0]); n++) {
+      const Step& step = STEPS[n];
+      uint8_t entry = palette.index(strip.getPixel(0));
+
+      if (n == 2) {
+        palette.clear();
+        palette.set(1, step.color);
+      } else {
+        palette.set(entry, step.color);
+      }
+      reference.fillRange(0, PIXELS, step.color);
+
+      MockHal::advanceMicros(1000);
+      unsigned long long before = emittedBytes();
+      strip.finishDraw();
+      bool sent = emittedBytes() != before;
+
+      if (sent != step.change || strip.getPixel(0) != step.color) {
+        printf("palette: %s %s the frame\n", step.label,
+               sent ? "sent" : "didn't send");
+        failures++;
+      }
+
+      if (strip.getEstimatedMilliamps() !=
+          reference.getEstimatedMilliamps()) {
+        printf("palette: %s estimated %dmA, expected %dmA\n", step.label,
+               strip.getEstimatedMilliamps(),
+               reference.getEstimatedMilliamps());
+        failures++;
+      }
+    }
+
+    // A fixed palette draws new colors as the nearest entry.
+    palette.setFixed(true);
+    int count = palette.getCount();
+    strip.drawSolid(Color{0, 200, 0, 0});
+    if (palette.getCount() != count) {
+      printf("palette: fixed palette grew to %d\n", palette.getCount());
+      failures++;
+    }
+
+    // No palette means the shared one.
+    strip.setPalette(NULL);
+    strip.drawSolid(GREEN);
+    if (strip.getPixel(0) != GREEN) {
+      printf("palette: no palette drew the wrong color\n");
+      failures++;
+    }
+
+    return failures;
+  }
+
+  // Cycles longer than micros() counts.
+  int checkLongCycles() {
+    const int PIXELS = 3000;
+    const int LIT = 2500;
+    int failures = 0;
+
+    MockHal::reset();
+
+    DotStrip strip(PIXELS);
+    BasicPattern<DotStrip> pattern(&strip);
+    pattern.setPattern(TEST, BLACK, BLACK, 1000);
+    pattern.drawUpdate();
+    pattern.drawUpdate();
+
+    // 4 SOLID steps of 1s, then 4 steps of 0.5s per pixel. Jump to the
+    // third color on pixel LIT, in steps micros() can measure.
+    unsigned long long target = 4000000ULL + (LIT * 4 + 2) * 500000ULL;
+    unsigned long long jump = 1000000000ULL;
+    for (unsigned long long t = 0; t < target; t += jump) {
+      MockHal::advanceMicros(target - t < jump ? target - t : jump);
+      pattern.drawUpdate();
+    }
+
+    int lit = 0;
+    for (int i = 0; i < PIXELS; i++) {
+      lit += strip.getPixel(i) != BLACK;
+    }
+    if (lit != 1 || strip.getPixel(LIT) != BLUE) {
+      printf("long: TEST lit %d pixels, pixel %d is %s\n", lit, LIT,
+             strip.getPixel(LIT) == BLUE ? "BLUE" : "not BLUE");
+      failures++;
+    }
+
+    // Speeds longer than 2^32 us wait as long as a pattern can.
+    pattern.setPattern(SOLID, RED, RED, 5000000);
+    while (!pattern.drawUpdate()) {
+      advanceToNextDraw(pattern);
+    }
+    system_tick_t start = micros();
+    pattern.drawUpdate();
+    if (pattern.getNextDraw() - start != PATTERN_MAX_DELAY) {
+      printf("long: SOLID waits %lu us\n",
+             (unsigned long)(pattern.getNextDraw() - start));
+      failures++;
+    }
+
+    return failures;
+  }
+
+  template<typename StripT>
+  void measure(StripType type, StripT* strip, const PatternCase& test) {
+    BasicPattern<StripT> pattern(strip);
+
+    // The initial SOLID pattern hands over on the first update.
+    pattern.setPattern(test.pattern, RED, BLUE, test.speed);
+    pattern.drawUpdate();
+    advanceToNextDraw(pattern);
+
+    long frames = PIXEL_BUDGET / strip->getPixelCount();
+    if (frames < 50)
+      frames = 50;
+    if (frames > 20000)
+      frames = 20000;
+
+    unsigned long long startBytes = emittedBytes();
+    Bench::Timer timer;
+
+    for (long i = 0; i < frames; i++) {
+      pattern.drawUpdate();
+      advanceToNextDraw(pattern);
+    }
+
+    double ns = timer.elapsedNs();
+    unsigned long long bytes = emittedBytes() - startBytes;
+
+    printf("%-14s %-10s %6d %7ld %14.1f %10.2f %12.1f\n",
+           STRIP_LABELS[type], PATTERN_LABELS[test.pattern],
+           strip->getPixelCount(), frames,
+           ns / frames, ns / frames / strip->getPixelCount(),
+           (double)bytes / frames);
+  }
+
+  void runCase(StripType type, int pixelCount, const PatternCase& test) {
+    MockHal::reset();
+
+    ColorStrip* strip = createStrip(type, pixelCount);
+
+    switch (type) {
+      case DIGITAL_STATIC:
+        measure(type, static_cast<DigitalStrip*>(strip), test);
+        break;
+      case DOT_STATIC:
+        measure(type, static_cast<DotStrip*>(strip), test);
+        break;
+      case NEO_STATIC:
+        measure(type, static_cast<NeoStrip*>(strip), test);
+        break;
+      default:
+        measure(type, strip, test);
+        break;
+    }
+
+    delete strip;
+  }
+}
+
+int main(int argc, char** argv) {
+  int maxPixels = argc > 1 ? atoi(argv[1]) : 10000;
+  const char* stripFilter = argc > 2 ? argv[2] : NULL;
+  const char* patternFilter = argc > 3 ? argv[3] : NULL;
+
+  int failures = checkRanges("ranges", PIXEL_COLOR);
+  failures += checkRanges("ranges-rgb888", PIXEL_RGB888);
+  failures += checkRanges("ranges-rgb565", PIXEL_RGB565);
+  printf("ranges: %d failures\n", failures);
+
+  int blobFailures = checkBlobCounts();
+  printf("blobs: %d failures\n", blobFailures);
+  failures += blobFailures;
+
+  int paletteFailures = checkPalette();
+  printf("palette: %d failures\n", paletteFailures);
+  failures += paletteFailures;
+
+  int longFailures = checkLongCycles();
+  printf("long: %d failures\n\n", longFailures);
+  failures += longFailures;
+
+  printf("%-14s %-10s %6s %7s %14s %10s %12s\n",
+         "strip", "pattern", "pixels", "frames",
+         "ns/frame", "ns/pixel", "bytes/frame");
+
+  for (int type = 0; type < STRIP_TYPE_COUNT; type++) {
+    if (stripFilter && strcmp(stripFilter, STRIP_LABELS[type]))
+      continue;
+
+    for (size_t p = 0; p < sizeof(PATTERNS) / sizeof(PATTERNS[0]); p++) {
+      const PatternCase& test = PATTERNS[p];
+
+      if (patternFilter && strcmp(patternFilter, PATTERN_LABELS[test.pattern]))
+        continue;
+
+      for (size_t c = 0; c < sizeof(PIXEL_COUNTS) / sizeof(PIXEL_COUNTS[0]); c++) {
+        int pixelCount = PIXEL_COUNTS[c];
+        if (pixelCount > maxPixels)
+          break;
+
+        runCase((StripType)type, pixelCount, test);
+
+        // An LED strip is always a single pixel.
+        if (type == LED)
+          break;
+      }
+    }
+  }
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,186 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+//
+// Checks and benchmarks for the render thread (render-thread.h).
+//
+// The command queue is pushed from one thread and popped on another, checking
+// every item arrives once, in order. Then a PatternRenderer draws two strips
+// while this thread queues pattern changes at random intervals, checking each
+// pattern only ever switches to whole, queued descriptions, in order, and
+// ends on the last one queued. Exits non zero if any check fails.
+//
+//   render-bench [commands]
+//
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "bench.h"
+#include "particle-strip.h"
+
+namespace {
+
+  const int PATTERNS = 2;
+
+  // Checked by the render thread, read here once it has stopped.
+  Pattern* patterns[PATTERNS];
+  std::atomic<int> lastApplied[PATTERNS];
+  int switches[PATTERNS];
+  int badSwitches = 0;
+
+  // Every field depends on the command number, so a description assembled
+  // from two commands can be spotted.
+  PatternDescription command(int n) {
+    Color a = { 0, (uint8_t)n, (uint8_t)(n >> 8), (uint8_t)(n >> 16) };
+    Color b = { 0, (uint8_t)~n, (uint8_t)(~n >> 8), (uint8_t)(~n >> 16) };
+    return PatternDescription(SOLID, a, b, 1 + n % 97);
+  }
+
+  // Called on the render thread after a pattern switches.
+  void patternUpdated(Pattern* pattern) {
+    int p = pattern == patterns[0] ? 0 : 1;
+    PatternDescription active = pattern->getPattern();
+
+    // The initial pattern.
+    if (active.pattern == SOLID && active.speed == 100)
+      return;
+
+    int n = active.a.red | active.a.green << 8 | active.a.blue << 16;
+    if (active != command(n) || n <= lastApplied[p].load()) {
+      if (badSwitches++ < 10)
+        printf("pattern %d: bad switch to %d after %d\n",
+               p, n, lastApplied[p].load());
+    }
+
+    lastApplied[p].store(n);
+    switches[p]++;
+  }
+
+  int checkQueue(int items) {
+    SpscQueue<int, 16> queue;
+    int failures = 0;
+    long fullRetries = 0;
+
+    Bench::Timer timer;
+
+    std::thread consumer([&queue, &failures, items]() {
+      int expected = 0;
+      while (expected < items) {
+        int item;
+        if (!queue.pop(&item)) {
+          std::this_thread::yield();
+          continue;
+        }
+
+        if (item != expected && failures++ < 10)
+          printf("queue: popped %d, expected %d\n", item, expected);
+        expected = item + 1;
+      }
+    });
+
+    for (int i = 0; i < items; i++) {
+      while (!queue.push(i)) {
+        fullRetries++;
+        std::this_thread::yield();
+      }
+    }
+    consumer.join();
+
+    printf("queue: %d items, %.1f ns/item, %ld full retries, %d failures\n",
+           items, timer.elapsedNs() / items, fullRetries, failures);
+    return failures;
+  }
+
+  int checkRenderer(int commands) {
+    MockHal::reset();
+
+    DotStrip dot(60);
+    DigitalStrip digital(32, false, PIXEL_COLOR, SPI1);
+    Pattern dotPattern(&dot);
+    Pattern digitalPattern(&digital);
+    patterns[0] = &dotPattern;
+    patterns[1] = &digitalPattern;
+
+    PatternRenderer renderer;
+    for (int p = 0; p < PATTERNS; p++) {
+      lastApplied[p].store(-1);
+      switches[p] = 0;
+      renderer.add(patterns[p], patternUpdated);
+    }
+
+    // From here until stop(), only the render thread uses the mock HAL.
+    renderer.start();
+
+    long fullRetries = 0;
+    double pushNs = 0;
+
+    for (int n = 0; n < commands; n++) {
+      Bench::Timer timer;
+      while (!renderer.setPattern(patterns[n % PATTERNS], command(n))) {
+        fullRetries++;
+        std::this_thread::yield();
+      }
+      pushNs += timer.elapsedNs();
+
+      // Stall now and then, like a slow loop() or cloud call.
+      if (n % 100 == 99)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // Wait for the last command to each pattern.
+    std::chrono::steady_clock::time_point giveUp =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    int failures = 0;
+
+    for (int p = 0; p < PATTERNS; p++) {
+      int last = commands - PATTERNS + p;
+      while (lastApplied[p].load() != last &&
+             std::chrono::steady_clock::now() < giveUp) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+
+      if (lastApplied[p].load() != last) {
+        printf("pattern %d: ended on %d, expected %d\n",
+               p, lastApplied[p].load(), last);
+        failures++;
+      }
+    }
+
+    renderer.stop();
+    failures += badSwitches;
+
+    printf("renderer: %d commands, %.1f ns/setPattern, %ld full retries, "
+           "%d + %d switches, %llu frames, %d failures\n",
+           commands, pushNs / commands, fullRetries, switches[0], switches[1],
+           MockHal::counters().spiTransfers, failures);
+    return failures;
+  }
+}
+
+int main(int argc, char** argv) {
+  int commands = argc > 1 ? atoi(argv[1]) : 10000;
+
+  int failures = checkQueue(commands * 100);
+  failures += checkRenderer(commands);
+
+  return failures ? 1 : 0;
+}
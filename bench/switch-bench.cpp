@@ -0,0 +1,365 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+//
+// Checks and benchmarks for switching patterns (crossfade.h).
+//
+// Each pattern is given a slow animation cycle, then told to switch. The time
+// until the new pattern shows is measured for Pattern, which waits for a
+// clean break, and checked against the bound for CrossfadePattern. Fades are
+// checked to move steadily from the old colors to the new, ending exactly on
+// the new, and to keep the strip's power estimate right under a budget. Then
+// the cost of a frame is timed, while fading and not. Exits non zero if any
+// check fails.
+//
+//   switch-bench [frames]
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "particle-strip.h"
+
+namespace {
+
+  struct SlowCase {
+    PatternType pattern;
+    int speed;
+  };
+
+  // Clean breaks at least a few seconds apart.
+  const SlowCase SLOW_CASES[] = {
+    { PULSE, 10000 },
+    { CYLON, 20000 },
+    { FLICKER, 1000 },
+    { ALTERNATE, 5000 },
+  };
+
+  const char* PATTERN_LABELS[] = {
+    "SOLID", "PULSE", "CYLON", "ALTERNATE", "FLICKER", "LAVA", "TEST"
+  };
+
+  const PatternDescription DOORBELL(SOLID, BLUE, BLACK, 1000);
+
+  // Longest to wait for a switch, in us.
+  const unsigned long long GIVE_UP = 60000000;
+
+  template<typename PatternT>
+  void advanceToNextDraw(PatternT& pattern) {
+    int32_t wait = pattern.getNextDraw() - micros();
+    if (wait > 0)
+      MockHal::advanceMicros(wait);
+  }
+
+  // Run a pattern for ms.
+  template<typename PatternT>
+  void run(PatternT& pattern, unsigned long ms) {
+    unsigned long long end = MockHal::now() + ms * 1000ULL;
+    while (true) {
+      advanceToNextDraw(pattern);
+      if (MockHal::now() > end)
+        break;
+      pattern.drawUpdate();
+    }
+  }
+
+  // us from setPattern() until the pattern is switched.
+  template<typename PatternT>
+  unsigned long long switchLatency(PatternT& pattern) {
+    unsigned long long start = MockHal::now();
+    pattern.setPattern(DOORBELL);
+
+    while (pattern.getPattern() != DOORBELL &&
+           MockHal::now() - start < GIVE_UP) {
+      advanceToNextDraw(pattern);
+      pattern.drawUpdate();
+    }
+
+    return MockHal::now() - start;
+  }
+
+  int checkLatency(unsigned long maxLatency) {
+    int failures = 0;
+
+    printf("%-10s %14s %14s\n", "pattern", "pattern us", "crossfade us");
+
+    for (size_t c = 0; c < sizeof(SLOW_CASES) / sizeof(SLOW_CASES[0]); c++) {
+      const SlowCase& test = SLOW_CASES[c];
+
+      MockHal::reset();
+      DotStrip plainStrip(60);
+      Pattern plain(&plainStrip);
+      plain.setPattern(test.pattern, RED, GREEN, test.speed);
+      run(plain, 1500);
+      unsigned long long plainLatency = switchLatency(plain);
+
+      MockHal::reset();
+      DotStrip fadeStrip(60);
+      CrossfadePattern fade(&fadeStrip, 200, maxLatency);
+      fade.setPattern(test.pattern, RED, GREEN, test.speed);
+      run(fade, 1500);
+      unsigned long long fadeLatency = switchLatency(fade);
+
+      printf("%-10s %14llu %14llu\n",
+             PATTERN_LABELS[test.pattern], plainLatency, fadeLatency);
+
+      if (fadeLatency > maxLatency * 1000 + fadeStrip.getFrameInterval()) {
+        printf("%s: switched after %lluus, over %lums\n",
+               PATTERN_LABELS[test.pattern], fadeLatency, maxLatency);
+        failures++;
+      }
+
+      // Once faded, only the new pattern shows.
+      run(fade, 250);
+      for (int i = 0; i < fadeStrip.getPixelCount(); i++) {
+        if (fadeStrip.getPixel(i) != BLUE) {
+          printf("%s: pixel %d not BLUE after the fade\n",
+                 PATTERN_LABELS[test.pattern], i);
+          failures++;
+          break;
+        }
+      }
+    }
+
+    return failures;
+  }
+
+  // Fade from RED to BLUE, on strips that blend in place, and pixel by pixel.
+  template<typename StripT>
+  int checkFade(const char* label, StripT* strip) {
+    const unsigned long FADE = 300;
+    int failures = 0;
+
+    BasicCrossfadePattern<StripT> fade(strip, FADE);
+    fade.setPattern(SOLID, RED, BLACK, 10000);
+    run(fade, 10);
+
+    fade.setPattern(DOORBELL);
+    fade.drawUpdate();
+
+    int frames = 0;
+    Color last = strip->getPixel(0);
+    if (!fade.isFading() || last != RED) {
+      printf("%s: fade didn't start from RED\n", label);
+      failures++;
+    }
+
+    while (fade.isFading() && frames < 1000) {
+      advanceToNextDraw(fade);
+      fade.drawUpdate();
+      frames++;
+
+      Color now = strip->getPixel(0);
+      if (now.red > last.red || now.blue < last.blue ||
+          now.green || now != strip->getPixel(strip->getPixelCount() - 1)) {
+        printf("%s: fade went from %02x%02x%02x to %02x%02x%02x\n", label,
+               last.red, last.green, last.blue, now.red, now.green, now.blue);
+        failures++;
+        break;
+      }
+      last = now;
+    }
+
+    // A frame per frame interval.
+    int expected = FADE * 1000 / strip->getFrameInterval();
+    if (last != BLUE || frames < expected - 1 || frames > expected + 1) {
+      printf("%s: fade ended on %02x%02x%02x after %d frames\n", label,
+             last.red, last.green, last.blue, frames);
+      failures++;
+    }
+
+    return failures;
+  }
+
+  // Fade from BLACK to WHITE on 100 pixels, with a 1000mA budget. The
+  // strip's estimate must stay within the budget, and match a strip that
+  // recounts every pixel.
+  int checkPower() {
+    const int PIXELS = 100;
+    const int BUDGET = 1000;
+    int failures = 0;
+
+    MockHal::reset();
+
+    DotStrip strip(PIXELS);
+    DotStrip recount(PIXELS);
+    strip.setPowerBudget(BUDGET);
+    recount.setPowerBudget(BUDGET);
+
+    CrossfadePattern fade(&strip, 300);
+    fade.setPattern(SOLID, BLACK, BLACK, 10000);
+    run(fade, 10);
+    fade.setPattern(SOLID, WHITE, BLACK, 10000);
+
+    for (int f = 0; f < 100; f++) {
+      advanceToNextDraw(fade);
+      fade.drawUpdate();
+
+      // Writes through getPixelBuffer() make the strip recount.
+      memcpy(recount.getPixelBuffer(), strip.readPixelBuffer(),
+             PIXELS * sizeof(Color));
+      recount.finishDraw();
+
+      int milliamps = strip.getEstimatedMilliamps();
+      if (milliamps > BUDGET ||
+          milliamps != recount.getEstimatedMilliamps()) {
+        printf("power: frame %d estimated %dmA, recounted %dmA\n", f,
+               milliamps, recount.getEstimatedMilliamps());
+        failures++;
+        break;
+      }
+    }
+
+    if (strip.getPixel(0) != WHITE ||
+        strip.getEstimatedMilliamps() < BUDGET * 9 / 10) {
+      printf("power: WHITE estimated at %dmA\n",
+             strip.getEstimatedMilliamps());
+      failures++;
+    }
+
+    return failures;
+  }
+
+  // A slow pattern, due long after a fast one. Once switching, it must come
+  // to the front of the scheduler. An empty scheduler only sleeps briefly.
+  int checkScheduler() {
+    MockHal::reset();
+
+    DotStrip slowStrip(10);
+    DotStrip fastStrip(10);
+    CrossfadePattern slow(&slowStrip);
+    CrossfadePattern fast(&fastStrip);
+
+    BasicPatternScheduler<CrossfadePattern> scheduler;
+    if (scheduler.drawUpdate() != SCHEDULER_IDLE_DELAY) {
+      printf("scheduler: empty, sleeps for %lu ms\n", scheduler.drawUpdate());
+      return 1;
+    }
+
+    scheduler.add(&slow);
+    scheduler.add(&fast);
+
+    slow.setPattern(SOLID, RED, BLACK, 10000);
+    fast.setPattern(PULSE, RED, BLACK, 1000);
+    for (int i = 0; i < 100; i++) {
+      MockHal::advanceMillis(scheduler.drawUpdate());
+    }
+
+    slow.setPattern(DOORBELL);
+    scheduler.reschedule();
+    scheduler.drawUpdate();
+
+    if (slow.getPattern() != DOORBELL) {
+      printf("scheduler: switch waited for the slow pattern\n");
+      return 1;
+    }
+    return 0;
+  }
+
+  template<typename PatternT>
+  void timeFrames(const char* label, ColorStrip* strip, PatternT& pattern,
+                  bool fading, int frames) {
+    pattern.setPattern(LAVA, RED, BLUE, 200);
+    run(pattern, 100);
+
+    double ns = 0;
+    for (int f = 0; f < frames; f++) {
+      // Restart the fade before it ends.
+      if (fading && f % 20 == 0) {
+        pattern.setPattern(f % 40 ? LAVA : CYLON, RED, BLUE, 200);
+      }
+
+      advanceToNextDraw(pattern);
+      Bench::Timer timer;
+      pattern.drawUpdate();
+      ns += timer.elapsedNs();
+    }
+
+    printf("%-18s %6d %12.1f %10.2f\n", label, strip->getPixelCount(),
+           ns / frames, ns / frames / strip->getPixelCount());
+  }
+
+  void timing(int frames) {
+    const int PIXEL_COUNTS[] = { 60, 300, 1000 };
+
+    printf("\n%-18s %6s %12s %10s\n", "case", "pixels", "ns/frame",
+           "ns/pixel");
+
+    for (size_t c = 0; c < sizeof(PIXEL_COUNTS) / sizeof(PIXEL_COUNTS[0]);
+         c++) {
+      int pixelCount = PIXEL_COUNTS[c];
+
+      MockHal::reset();
+      {
+        DotStrip strip(pixelCount);
+        Pattern pattern(&strip);
+        timeFrames("pattern", &strip, pattern, false, frames);
+      }
+
+      MockHal::reset();
+      {
+        DotStrip strip(pixelCount);
+        CrossfadePattern pattern(&strip, 1000);
+        timeFrames("crossfade", &strip, pattern, false, frames);
+      }
+
+      MockHal::reset();
+      {
+        DotStrip strip(pixelCount);
+        CrossfadePattern pattern(&strip, 1000);
+        timeFrames("crossfade-fading", &strip, pattern, true, frames);
+      }
+
+      MockHal::reset();
+      {
+        DotStrip strip(pixelCount, false, PIXEL_RGB565);
+        CrossfadePattern pattern(&strip, 1000);
+        timeFrames("rgb565-fading", &strip, pattern, true, frames);
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  int frames = argc > 1 ? atoi(argv[1]) : 2000;
+
+  int failures = checkLatency(0);
+  failures += checkLatency(50);
+
+  MockHal::reset();
+  {
+    DotStrip strip(30);
+    failures += checkFade("dot", &strip);
+  }
+
+  MockHal::reset();
+  {
+    DotStrip strip(30, false, PIXEL_RGB888);
+    failures += checkFade("dot-rgb888", &strip);
+  }
+
+  failures += checkScheduler();
+  failures += checkPower();
+  printf("switch: %d failures\n", failures);
+
+  timing(frames);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,253 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+//
+// Fuzz and benchmark for the pattern and color text conversions in text.h.
+//
+// Random patterns are checked to round trip through formatPattern and
+// parsePattern, and random mutations of valid text are parsed to check they
+// never overrun. Registered color names are checked to round trip too. Then
+// the buffer and String versions are timed, counting heap allocations. Exits
+// non zero if any check fails.
+//
+//   text-bench [iterations]
+//
+
+#include <new>
+#include <stdio.h>
+
+#include "bench.h"
+#include "particle-strip.h"
+
+namespace {
+  unsigned long long allocations = 0;
+}
+
+void* operator new(size_t size) {
+  allocations++;
+  void* result = malloc(size ? size : 1);
+  if (!result)
+    throw std::bad_alloc();
+  return result;
+}
+
+void operator delete(void* pointer) noexcept {
+  free(pointer);
+}
+
+namespace {
+
+  const char ALPHABET[] = "0123456789abcdefxABCDEFX,_-SOLIDPULSECYLONRANDOM ";
+
+  Color randomTextColor() {
+    // Favor named colors, since they are formatted differently.
+    if (random(4) == 0)
+      return COLOR_NAME_MAP[random(COLOR_NAME_MAP_SIZE)].color;
+
+    Color color = randomColor();
+    color.special = random(256);
+    return color;
+  }
+
+  PatternDescription randomPattern() {
+    return PatternDescription((PatternType)random(PATTERN_COUNT),
+                              randomTextColor(),
+                              randomTextColor(),
+                              random(0, 0x7FFFFFFF));
+  }
+
+  int roundTrip(long iterations) {
+    int failures = 0;
+
+    for (long i = 0; i < iterations; i++) {
+      PatternDescription pattern = randomPattern();
+
+      char text[PATTERN_TEXT_SIZE];
+      size_t length = formatPattern(pattern, text, sizeof(text));
+
+      PatternDescription parsed;
+      if (length >= sizeof(text) ||
+          !parsePattern(text, &parsed) ||
+          parsed != pattern) {
+        if (failures++ < 10)
+          printf("round trip failed: %s\n", text);
+      }
+
+      // Truncated formatting must still be terminated, and report the full
+      // length.
+      size_t size = random(length + 1);
+      char truncated[PATTERN_TEXT_SIZE];
+      memset(truncated, '#', sizeof(truncated));
+      if (formatPattern(pattern, truncated, size) != length ||
+          (size && strlen(truncated) != size - 1) ||
+          truncated[size] != '#') {
+        if (failures++ < 10)
+          printf("truncation failed: %s at %u\n", text, (unsigned)size);
+      }
+    }
+
+    return failures;
+  }
+
+  int mutations(long iterations) {
+    int failures = 0;
+
+    for (long i = 0; i < iterations; i++) {
+      char text[PATTERN_TEXT_SIZE];
+      size_t length = formatPattern(randomPattern(), text, sizeof(text));
+
+      // Overwrite, or cut short, a few characters.
+      int edits = random(1, 4);
+      for (int e = 0; e < edits; e++) {
+        size_t at = random(length);
+        text[at] = random(8) ? ALPHABET[random(sizeof(ALPHABET) - 1)] : '\0';
+      }
+
+      PatternDescription parsed;
+      if (!parsePattern(text, &parsed) && parsed != PatternDescription()) {
+        if (failures++ < 10)
+          printf("failed parse not reset: %s\n", text);
+      }
+
+      if (parsed.pattern < 0 || parsed.pattern >= PATTERN_COUNT ||
+          parsed.speed < 0) {
+        if (failures++ < 10)
+          printf("invalid parse: %s\n", text);
+      }
+    }
+
+    return failures;
+  }
+
+  // Names registered at run time are used in both directions.
+  int userNames() {
+    const Color ORANGE = Color{0x00, 0xFF, 0xA5, 0x00};
+    int failures = 0;
+
+    if (!registerColorName("ORANGE", ORANGE) ||
+        registerColorName("ORANGE", BLUE) ||
+        registerColorName("RED", BLUE)) {
+      printf("registerColorName failed\n");
+      failures++;
+    }
+
+    // Longer than any built in name, so it wouldn't fit COLOR_TEXT_SIZE.
+    const Color GLOW = Color{0x00, 0xFF, 0x60, 0x10};
+    if (registerColorName("HALLOWEEN_ORANGE_GLOW", GLOW) ||
+        !registerColorName("PUMPKIN_ORANGE", GLOW)) {
+      printf("registerColorName length limit failed\n");
+      failures++;
+    }
+
+    char text[PATTERN_TEXT_SIZE];
+    PatternDescription glow(ALTERNATE, GLOW, GLOW, -2147483647 - 1);
+    if (formatPattern(glow, text, sizeof(text)) >= sizeof(text)) {
+      printf("user name doesn't fit PATTERN_TEXT_SIZE: %s\n", text);
+      failures++;
+    }
+
+    PatternDescription pattern(LAVA, RED, ORANGE, 400);
+    PatternDescription parsed;
+    if (patternToString(pattern) != "LAVA,RED,ORANGE,400" ||
+        !parsePattern("LAVA,RED,ORANGE,400", &parsed) ||
+        parsed != pattern) {
+      printf("user name round trip failed\n");
+      failures++;
+    }
+
+    clearColorNames();
+    return failures;
+  }
+
+  void report(const char* name, double ns, long iterations,
+              unsigned long long allocs) {
+    printf("%-24s %10.1f ns/call %8.2f allocs/call\n",
+           name, ns / iterations, (double)allocs / iterations);
+  }
+
+  void timing(long iterations) {
+    PatternDescription pattern(CYLON, BLUE, Color{0x00, 0x05, 0x05, 0x05},
+                               1000);
+    char text[PATTERN_TEXT_SIZE];
+    formatPattern(pattern, text, sizeof(text));
+    String textString(text);
+
+    {
+      unsigned long long start = allocations;
+      Bench::Timer timer;
+      for (long i = 0; i < iterations; i++) {
+        char buffer[PATTERN_TEXT_SIZE];
+        formatPattern(pattern, buffer, sizeof(buffer));
+        Bench::doNotOptimize(buffer);
+      }
+      report("formatPattern", timer.elapsedNs(), iterations,
+             allocations - start);
+    }
+
+    {
+      unsigned long long start = allocations;
+      Bench::Timer timer;
+      for (long i = 0; i < iterations; i++) {
+        PatternDescription parsed;
+        parsePattern(text, &parsed);
+        Bench::doNotOptimize(parsed);
+      }
+      report("parsePattern", timer.elapsedNs(), iterations,
+             allocations - start);
+    }
+
+    {
+      unsigned long long start = allocations;
+      Bench::Timer timer;
+      for (long i = 0; i < iterations; i++) {
+        String result = patternToString(pattern);
+        Bench::doNotOptimize(result);
+      }
+      report("patternToString", timer.elapsedNs(), iterations,
+             allocations - start);
+    }
+
+    {
+      unsigned long long start = allocations;
+      Bench::Timer timer;
+      for (long i = 0; i < iterations; i++) {
+        PatternDescription parsed = stringToPattern(textString);
+        Bench::doNotOptimize(parsed);
+      }
+      report("stringToPattern", timer.elapsedNs(), iterations,
+             allocations - start);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+
+  MockHal::reset();
+
+  int failures = (roundTrip(iterations) +
+                  mutations(iterations) +
+                  userNames());
+  printf("fuzz: %ld round trips, %ld mutations, %d failures\n",
+         iterations, iterations, failures);
+
+  timing(iterations);
+
+  return failures ? 1 : 0;
+}
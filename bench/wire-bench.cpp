@@ -0,0 +1,761 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+
+//
+// Checks and benchmarks for the strips that encode their own wire format.
+//
+// NeoSpiStrip frames are decoded from the recorded SPI bytes, checking every
+// symbol and the reset after each frame, and compared with the bytes NeoStrip
+// shows for the same frames. ParallelNeoStrips lanes are decoded the same
+// way, from the pulse widths on each pin of the mock GPIO port. Clocked strips
+// on SPI1 and software SPI are checked against SPI, along with async strips
+// on both buses, and strips with different clock speeds on one bus. Strips
+// with fixed buffers (FixedDotStrip, FixedDigitalStrip) are checked against
+// heap allocated ones.
+//
+// Then the cost of sending a frame is timed for each, along with the time the
+// caller is blocked, and the time interrupts are disabled on a device. Exits
+// non zero if any check fails.
+//
+//   wire-bench [frames]
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#include "bench.h"
+#include "particle-strip.h"
+
+namespace {
+
+  const int PIXEL_COUNTS[] = { 1, 8, 60, 300 };
+
+  struct NeoType {
+    uint8_t type;
+    const char* label;
+  };
+
+  const NeoType NEO_TYPES[] = {
+    { WS2812B, "WS2812B" },
+    { WS2812, "WS2812" },
+    { TM1803, "TM1803" },
+  };
+
+  // Each bit NeoStrip bit bangs takes 1.25us (2.5us at 400kHz).
+  double bitBangMicros(int pixelCount, uint8_t neoType) {
+    return pixelCount * 24 * (neoType == TM1803 ? 2.5 : 1.25);
+  }
+
+  // Decode one NeoSpiStrip frame, sent at "clock" Hz, back to color bytes.
+  // Each symbol must be a single high pulse, with the bit period within 15%
+  // of the pixel type's, and the high time within the WS2812B limits (scaled
+  // to the period, so doubled for TM1803). Returns false if any symbol or the
+  // reset is malformed.
+  bool decodeFrame(const uint8_t* wire, int pixelCount, uint8_t neoType,
+                   unsigned clock, std::vector<uint8_t>* decoded) {
+    double nominal = neoType == TM1803 ? 2.5 : 1.25;
+    double bitMicros = 1e6 / clock;
+
+    int width = (int)(nominal / bitMicros + 0.5);
+    if (fabs(width * bitMicros - nominal) > nominal * 0.15)
+      return false;
+
+    int wireBit = 0;
+    for (int i = 0; i < pixelCount * 3; i++) {
+      uint8_t value = 0;
+      for (int b = 0; b < 8; b++) {
+        int high = 0;
+        bool pulse = true;
+        for (int s = 0; s < width; s++, wireBit++) {
+          bool bit = (wire[wireBit / 8] >> (7 - wireBit % 8)) & 1;
+          if (bit && !pulse)
+            return false;
+          pulse = bit;
+          high += bit;
+        }
+
+        // T0H 400ns and T1H 800ns, within 150ns, of a 1.25us bit.
+        double highMicros = high * bitMicros * 1.25 / nominal;
+        bool one = highMicros > 0.6;
+        if (fabs(highMicros - (one ? 0.8 : 0.4)) > 0.15)
+          return false;
+        value = (value << 1) | one;
+      }
+      decoded->push_back(value);
+    }
+    wire += wireBit / 8;
+
+    int resetBytes = (NeoSpiStrip::wireSize(pixelCount, neoType) -
+                      wireBit / 8);
+    if (wireBit % 8 || resetBytes * 8.0e6 / clock < NEO_SPI_RESET_US)
+      return false;
+
+    for (int i = 0; i < resetBytes; i++) {
+      if (wire[i])
+        return false;
+    }
+
+    return true;
+  }
+
+  // Draw the same random frames on a NeoStrip and a NeoSpiStrip, and check
+  // the SPI stream decodes to the NeoStrip bytes.
+  int checkNeoSpi(const NeoType& neo, int pixelCount, int frames) {
+    MockHal::reset();
+
+    NeoStrip reference(pixelCount, D2, neo.type);
+    NeoSpiStrip strip(pixelCount, neo.type);
+
+    // Skip the frames sent by the constructors.
+    MockHal::setRecording(true);
+
+    int failures = 0;
+    unsigned clock = MockHal::spiClockSpeed();
+    if (clock != NeoSpiStrip::clockSpeed(neo.type)) {
+      printf("%s: clock %u\n", neo.label, clock);
+      failures++;
+    }
+
+    for (int f = 0; f < frames; f++) {
+      // Output settings apply to both.
+      bool gamma = f % 3 == 1;
+      uint8_t brightness = f % 4 == 2 ? 100 : 255;
+      reference.setGamma(gamma);
+      strip.setGamma(gamma);
+      reference.setBrightness(brightness);
+      strip.setBrightness(brightness);
+
+      for (int i = 0; i < pixelCount; i++) {
+        Color color = randomColor();
+        reference.drawPixel(color);
+        strip.drawPixel(color);
+      }
+      reference.finishDraw();
+      strip.finishDraw();
+    }
+
+    const std::vector<uint8_t>& expected = MockHal::neoPixelBytes(D2);
+    const std::vector<uint8_t>& wire = MockHal::spiBytes();
+    size_t frameSize = NeoSpiStrip::wireSize(pixelCount, neo.type);
+
+    if (wire.size() != frameSize * frames ||
+        expected.size() != (size_t)pixelCount * 3 * frames) {
+      printf("%s %d: sent %u bytes\n",
+             neo.label, pixelCount, (unsigned)wire.size());
+      return failures + 1;
+    }
+
+    std::vector<uint8_t> decoded;
+    for (int f = 0; f < frames; f++) {
+      if (!decodeFrame(&wire[f * frameSize], pixelCount, neo.type, clock,
+                       &decoded)) {
+        if (failures++ < 10)
+          printf("%s %d: bad frame %d\n", neo.label, pixelCount, f);
+      }
+    }
+
+    if (decoded != expected) {
+      printf("%s %d: decoded bytes differ\n", neo.label, pixelCount);
+      failures++;
+    }
+
+    return failures;
+  }
+
+  // A pin's pulses, decoded to bytes. Frames are split by the reset time.
+  struct PinDecoder {
+    uint16_t mask;
+    bool high;
+    unsigned long long rise;
+    unsigned long long fall;
+    int frames;
+    int bits;
+    uint8_t value;
+    int errors;
+    std::vector<uint8_t> bytes;
+  };
+
+  // Send random frames on ParallelNeoStrips lanes, and on a NeoStrip per lane
+  // for reference. Each lane's pin is decoded from the port writes, checking
+  // the pulse timing, and compared with its reference.
+  int checkParallel(const NeoType& neo) {
+    const int LANES = 5;
+    const int LANE_PIXELS[LANES] = { 24, 60, 1, 7, 30 };
+    const int LONGEST = 60;
+    const int FRAMES = 5;
+
+    // D0-D4 are all on GPIOB, the mock's port 1.
+    const pin_t LANE_PINS[LANES] = { D0, D1, D2, D3, D4 };
+    const pin_t REFERENCE_PINS[LANES] = { A0, A1, A2, A3, A4 };
+    const int PORT = 1;
+
+    MockHal::reset();
+
+    ParallelNeoStrips parallel(neo.type);
+    NeoLane* lanes[LANES];
+    NeoStrip* references[LANES];
+    int failures = 0;
+
+    for (int l = 0; l < LANES; l++) {
+      // One lane draws in place.
+      lanes[l] = new NeoLane(LANE_PIXELS[l], neo.type,
+                             l == 1 ? PIXEL_WIRE : PIXEL_COLOR);
+      references[l] = new NeoStrip(LANE_PIXELS[l], REFERENCE_PINS[l],
+                                   neo.type);
+      if (!parallel.add(lanes[l], LANE_PINS[l])) {
+        printf("%s: add lane %d failed\n", neo.label, l);
+        failures++;
+      }
+    }
+
+    // D5 is on GPIOA.
+    NeoLane other(1, neo.type);
+    if (parallel.add(&other, D5)) {
+      printf("%s: added a lane on another port\n", neo.label);
+      failures++;
+    }
+
+    MockHal::setRecording(true);
+    unsigned long long offNanos = 0;
+
+    for (int f = 0; f < FRAMES; f++) {
+      uint8_t brightness = f == 2 ? 100 : 255;
+
+      for (int l = 0; l < LANES; l++) {
+        // PIXEL_WIRE lanes are sent as drawn.
+        if (l != 1) {
+          lanes[l]->setBrightness(brightness);
+          references[l]->setBrightness(brightness);
+        }
+
+        for (int i = 0; i < LANE_PIXELS[l]; i++) {
+          Color color = randomColor();
+          lanes[l]->drawPixel(color);
+          references[l]->drawPixel(color);
+        }
+        lanes[l]->finishDraw();
+        references[l]->finishDraw();
+      }
+
+      unsigned long long start = MockHal::interruptsOffNanos();
+      parallel.show();
+      offNanos += MockHal::interruptsOffNanos() - start;
+    }
+
+    double bitNanos = neo.type == TM1803 ? 2500 : 1250;
+
+    PinDecoder decoders[LANES];
+    for (int l = 0; l < LANES; l++) {
+      PinDecoder& d = decoders[l];
+      d.mask = HAL_Pin_Map()[LANE_PINS[l]].gpio_pin;
+      d.high = false;
+      d.rise = d.fall = 0;
+      d.frames = d.bits = d.value = d.errors = 0;
+    }
+
+    const std::vector<MockHal::PortWrite>& writes = MockHal::portWrites();
+    for (size_t w = 0; w < writes.size(); w++) {
+      if (writes[w].port != PORT)
+        continue;
+
+      for (int l = 0; l < LANES; l++) {
+        PinDecoder& d = decoders[l];
+        bool high = writes[w].state & d.mask;
+        if (high == d.high)
+          continue;
+
+        d.high = high;
+        unsigned long long nanos = writes[w].nanos;
+
+        if (high) {
+          // A gap longer than the reset time starts a new frame. Within a
+          // frame, bits can't start early.
+          if (d.frames == 0 || nanos - d.fall > 50000) {
+            d.errors += d.bits != 0;
+            d.frames++;
+          } else if (nanos - d.rise < bitNanos - 20) {
+            d.errors++;
+          }
+          d.rise = nanos;
+          continue;
+        }
+
+        // High for 1/3 of the bit for a 0, 2/3 for a 1.
+        d.fall = nanos;
+        double width = d.fall - d.rise;
+        bool one = width > bitNanos / 2;
+        if (fabs(width - bitNanos * (one ? 2 : 1) / 3) > 150)
+          d.errors++;
+
+        d.value = (d.value << 1) | one;
+        if (++d.bits == 8) {
+          d.bytes.push_back(d.value);
+          d.bits = 0;
+        }
+      }
+    }
+
+    for (int l = 0; l < LANES; l++) {
+      const PinDecoder& d = decoders[l];
+      bool matching = d.bytes == MockHal::neoPixelBytes(REFERENCE_PINS[l]);
+
+      if (d.errors || d.frames != FRAMES || d.bits || !matching) {
+        printf("%s lane %d: %d frames, %d timing errors, %s bytes\n",
+               neo.label, l, d.frames, d.errors,
+               matching ? "matching" : "different");
+        failures++;
+      }
+    }
+
+    // Interrupts are only off while the longest lane is sent.
+    double expected = FRAMES * LONGEST * 24 * bitNanos;
+    if (offNanos < expected || offNanos > expected * 1.1) {
+      printf("%s: interrupts off for %.0fus\n", neo.label, offNanos / 1000.0);
+      failures++;
+    }
+
+    for (int l = 0; l < LANES; l++) {
+      delete lanes[l];
+      delete references[l];
+    }
+
+    return failures;
+  }
+
+  // Bytes clocked out on software SPI, sampling dataMask on each rising edge
+  // of clockMask. Fails if any clock period is shorter than minNanos.
+  bool decodeSoftSpi(int port, uint16_t clockMask, uint16_t dataMask,
+                     double minNanos, std::vector<uint8_t>* bytes) {
+    const std::vector<MockHal::PortWrite>& writes = MockHal::portWrites();
+    bool clock = false;
+    bool first = true;
+    unsigned long long rise = 0;
+    int bits = 0;
+    uint8_t value = 0;
+
+    for (size_t w = 0; w < writes.size(); w++) {
+      if (writes[w].port != port)
+        continue;
+
+      bool high = writes[w].state & clockMask;
+      if (high == clock)
+        continue;
+
+      clock = high;
+      if (!high)
+        continue;
+
+      if (!first && writes[w].nanos - rise < minNanos)
+        return false;
+      first = false;
+      rise = writes[w].nanos;
+
+      value = (value << 1) | ((writes[w].state & dataMask) != 0);
+      if (++bits == 8) {
+        bytes->push_back(value);
+        bits = 0;
+      }
+    }
+
+    return bits == 0;
+  }
+
+  // Clocked strips on SPI1 and software SPI, compared with the same frames on
+  // SPI. Then async strips on both hardware buses, which should send at the
+  // same time, and strips with different clock speeds sharing a bus.
+  int checkBuses() {
+    const int PIXELS = 37;
+    const int FRAMES = 4;
+    int failures = 0;
+
+    // D3 and D4 are both on GPIOB, the mock's port 1.
+    const int PORT = 1;
+    const unsigned SOFT_CLOCK = 4 * MHZ;
+
+    for (int timed = 0; timed < 2; timed++) {
+      MockHal::reset();
+
+      DotStrip reference(PIXELS);
+      DotStrip spi1(PIXELS, false, PIXEL_COLOR, SPI1);
+      DigitalStrip soft(PIXELS, false, PIXEL_COLOR,
+                        SpiBus(D3, D4, timed ? SOFT_CLOCK : 0));
+      DigitalStrip softReference(PIXELS, false, PIXEL_COLOR, SPI1);
+
+      MockHal::setRecording(true);
+
+      for (int f = 0; f < FRAMES; f++) {
+        for (int i = 0; i < PIXELS; i++) {
+          Color color = randomColor();
+          reference.drawPixel(color);
+          spi1.drawPixel(color);
+          soft.drawPixel(color);
+          softReference.drawPixel(color);
+        }
+
+        MockHal::clearSpiBytes();
+        reference.finishDraw();
+        spi1.finishDraw();
+        if (MockHal::spiBytes(0) != MockHal::spiBytes(1)) {
+          printf("dot: SPI1 frame %d differs from SPI\n", f);
+          failures++;
+        }
+
+        MockHal::clearSpiBytes();
+        MockHal::clearPortWrites();
+        softReference.finishDraw();
+        soft.finishDraw();
+
+        std::vector<uint8_t> bytes;
+        double minNanos = timed ? 1000000000.0 / SOFT_CLOCK : 0;
+        bool valid = decodeSoftSpi(PORT, HAL_Pin_Map()[D3].gpio_pin,
+                                   HAL_Pin_Map()[D4].gpio_pin, minNanos,
+                                   &bytes);
+        if (!valid || bytes != MockHal::spiBytes(1)) {
+          printf("digital: %s software SPI frame %d %s\n",
+                 timed ? "timed" : "untimed", f,
+                 valid ? "differs from SPI1" : "has bad clock timing");
+          failures++;
+        }
+      }
+    }
+
+    // Async strips on separate buses overlap.
+    MockHal::reset();
+    {
+      DotStrip first(300, true);
+      DotStrip second(300, true, PIXEL_COLOR, SPI1);
+      MockHal::advanceMillis(100);
+
+      first.drawSolid(RED);
+      second.drawSolid(BLUE);
+      if (!MockHal::spiBusy(0) || !MockHal::spiBusy(1)) {
+        printf("async: SPI and SPI1 did not send at the same time\n");
+        failures++;
+      }
+      first.waitForSend();
+      second.waitForSend();
+    }
+
+    // An async strip deleted while sending waits for the transfer to finish
+    // before freeing the buffer it's sent from.
+    MockHal::reset();
+    {
+      DotStrip* strip = new DotStrip(300, true);
+      MockHal::advanceMillis(100);
+
+      strip->drawSolid(RED);
+      bool sending = MockHal::spiBusy(0);
+      delete strip;
+
+      if (!sending || MockHal::spiBusy(0)) {
+        printf("async: strip deleted while still sending\n");
+        failures++;
+      }
+    }
+
+    // Strips sharing a bus each get their own clock speed, rounded down to
+    // one the bus can divide down to. A strip with no speed gets the default,
+    // not the last strip's.
+    MockHal::reset();
+    {
+      DotStrip fast(10, false, PIXEL_COLOR, SpiBus(SPI, 12 * MHZ));
+      DigitalStrip slow(10, false, PIXEL_COLOR, SpiBus(SPI, 2 * MHZ));
+      DotStrip plain(10);
+
+      for (int f = 0; f < 2; f++) {
+        MockHal::advanceMillis(100);
+
+        fast.drawSolid(f ? RED : BLUE);
+        unsigned fastClock = MockHal::spiClockSpeed(0);
+        slow.drawSolid(f ? RED : BLUE);
+        unsigned slowClock = MockHal::spiClockSpeed(0);
+        plain.drawSolid(f ? RED : BLUE);
+        unsigned plainClock = MockHal::spiClockSpeed(0);
+
+        if (fastClock != spiBusClock(0, 12 * MHZ) ||
+            slowClock != spiBusClock(0, 2 * MHZ) ||
+            fastClock > 12 * MHZ || fastClock <= 6 * MHZ ||
+            slowClock > 2 * MHZ || slowClock <= 1 * MHZ ||
+            plainClock != spiDefaultClock(0)) {
+          printf("shared: sent at %u, %u and %u Hz\n", fastClock, slowClock,
+                 plainClock);
+          failures++;
+        }
+      }
+    }
+
+    // TM1829 pixels idle high, so can't be driven from MOSI at all.
+    MockHal::reset();
+    {
+      NeoSpiStrip strip(10, TM1829);
+      strip.drawSolid(RED);
+
+      if (strip.getPixelCount() || MockHal::counters().spiBytes) {
+        printf("tm1829: %d pixels, sent %llu bytes\n",
+               strip.getPixelCount(),
+               (unsigned long long)MockHal::counters().spiBytes);
+        failures++;
+      }
+    }
+
+    return failures;
+  }
+
+  // Draw the same random frames on a strip with fixed buffers, sending on
+  // SPI1, and on a heap allocated one sending on SPI, and compare the bytes.
+  template<typename FixedT, typename HeapT>
+  int checkFixed(const char* label, FixedT* fixed, HeapT* heap) {
+    const int FRAMES = 4;
+    int failures = 0;
+
+    if (fixed->getPixelCount() != heap->getPixelCount()) {
+      printf("%s: %d pixels\n", label, fixed->getPixelCount());
+      return 1;
+    }
+
+    MockHal::setRecording(true);
+
+    for (int f = 0; f < FRAMES; f++) {
+      MockHal::advanceMillis(100);
+
+      for (int i = 0; i < heap->getPixelCount(); i++) {
+        Color color = randomColor();
+        fixed->drawPixel(color);
+        heap->drawPixel(color);
+      }
+
+      MockHal::clearSpiBytes();
+      heap->finishDraw();
+      fixed->finishDraw();
+      heap->waitForSend();
+      fixed->waitForSend();
+
+      if (MockHal::spiBytes(0).empty() ||
+          MockHal::spiBytes(0) != MockHal::spiBytes(1)) {
+        printf("%s: frame %d differs from the heap strip\n", label, f);
+        failures++;
+      }
+    }
+
+    MockHal::setRecording(false);
+    return failures;
+  }
+
+  int checkFixedStrips() {
+    const int PIXELS = 37;
+    int failures = 0;
+
+    MockHal::reset();
+    {
+      FixedDotStrip<PIXELS> fixed(SPI1);
+      DotStrip heap(PIXELS);
+      failures += checkFixed("fixed-dot", &fixed, &heap);
+    }
+
+    MockHal::reset();
+    {
+      FixedDotStrip<PIXELS, true> fixed(SPI1);
+      DotStrip heap(PIXELS, true);
+      failures += checkFixed("fixed-dot-async", &fixed, &heap);
+    }
+
+    MockHal::reset();
+    {
+      FixedDotStrip<PIXELS, true, PIXEL_RGB565> fixed(SPI1);
+      DotStrip heap(PIXELS, true, PIXEL_RGB565);
+      failures += checkFixed("fixed-dot-rgb565", &fixed, &heap);
+    }
+
+    MockHal::reset();
+    {
+      FixedDigitalStrip<PIXELS> fixed(SPI1);
+      DigitalStrip heap(PIXELS);
+      failures += checkFixed("fixed-digital", &fixed, &heap);
+    }
+
+    MockHal::reset();
+    {
+      FixedDigitalStrip<PIXELS, true, PIXEL_RGB888> fixed(SPI1);
+      DigitalStrip heap(PIXELS, true, PIXEL_RGB888);
+      failures += checkFixed("fixed-digital-rgb888", &fixed, &heap);
+    }
+
+    return failures;
+  }
+
+  template<typename StripT>
+  void timeStrip(const char* label, StripT* strip, double irqOffMicros,
+                 int frames) {
+    Color colors[] = { RED, BLUE };
+
+    // Let any send from the constructor finish.
+    MockHal::advanceMillis(100);
+
+    double blockedMicros = 0;
+    Bench::Timer timer;
+
+    for (int f = 0; f < frames; f++) {
+      unsigned long long start = MockHal::now();
+      strip->drawSolid(colors[f % 2]);
+      blockedMicros += MockHal::now() - start;
+
+      // The next frame is due well after this one is sent.
+      MockHal::advanceMillis(20);
+    }
+
+    double ns = timer.elapsedNs();
+    int pixelCount = strip->getPixelCount();
+
+    printf("%-16s %6d %12.1f %10.2f %12.1f %12.1f\n",
+           label, pixelCount, ns / frames, ns / frames / pixelCount,
+           blockedMicros / frames, irqOffMicros);
+  }
+
+  // PARALLEL_LANES lanes of pixelCount pixels, against the same number of
+  // NeoStrips. Host time is for drawing and encoding the lanes; the pass
+  // itself is reported as blocked time.
+  void timeParallel(int pixelCount, int frames) {
+    const int PARALLEL_LANES = 5;
+    const pin_t LANE_PINS[PARALLEL_LANES] = { D0, D1, D2, D3, D4 };
+
+    ParallelNeoStrips parallel;
+    NeoLane* lanes[PARALLEL_LANES];
+    for (int l = 0; l < PARALLEL_LANES; l++) {
+      lanes[l] = new NeoLane(pixelCount);
+      parallel.add(lanes[l], LANE_PINS[l]);
+    }
+
+    Color colors[] = { RED, BLUE };
+    double drawNs = 0;
+    double blockedMicros = 0;
+    unsigned long long offStart = MockHal::interruptsOffNanos();
+
+    for (int f = 0; f < frames; f++) {
+      MockHal::advanceMillis(20);
+
+      Bench::Timer timer;
+      for (int l = 0; l < PARALLEL_LANES; l++) {
+        lanes[l]->drawSolid(colors[f % 2]);
+      }
+      drawNs += timer.elapsedNs();
+
+      unsigned long long start = MockHal::now();
+      parallel.show();
+      blockedMicros += MockHal::now() - start;
+    }
+
+    double offMicros = (MockHal::interruptsOffNanos() - offStart) / 1000.0;
+    int pixels = pixelCount * PARALLEL_LANES;
+
+    printf("%-16s %6d %12s %10s %12.1f %12.1f\n",
+           "neo x5", pixels, "", "", 0.0,
+           PARALLEL_LANES * bitBangMicros(pixelCount, WS2812B));
+    printf("%-16s %6d %12.1f %10.2f %12.1f %12.1f\n",
+           "parallel-neo x5", pixels, drawNs / frames, drawNs / frames / pixels,
+           blockedMicros / frames, offMicros / frames);
+
+    for (int l = 0; l < PARALLEL_LANES; l++) {
+      delete lanes[l];
+    }
+  }
+
+  void timing(int frames) {
+    printf("\n%-16s %6s %12s %10s %12s %12s\n",
+           "strip", "pixels", "ns/frame", "ns/pixel",
+           "blocked us", "irq off us");
+
+    for (size_t c = 0; c < sizeof(PIXEL_COUNTS) / sizeof(PIXEL_COUNTS[0]);
+         c++) {
+      int pixelCount = PIXEL_COUNTS[c];
+
+      MockHal::reset();
+      {
+        NeoStrip strip(pixelCount, D2);
+        timeStrip("neo", &strip, bitBangMicros(pixelCount, WS2812B), frames);
+      }
+
+      MockHal::reset();
+      {
+        NeoSpiStrip strip(pixelCount);
+        timeStrip("neo-spi", &strip, 0, frames);
+      }
+
+      MockHal::reset();
+      {
+        NeoSpiStrip strip(pixelCount, WS2812B, true);
+        timeStrip("neo-spi-async", &strip, 0, frames);
+      }
+
+      MockHal::reset();
+      {
+        DotStrip strip(pixelCount);
+        timeStrip("dot", &strip, 0, frames);
+      }
+
+      MockHal::reset();
+      {
+        DotStrip strip(pixelCount, false, PIXEL_COLOR, SpiBus(D3, D4));
+        timeStrip("dot-soft-spi", &strip, 0, frames);
+      }
+
+      // Each pass spins on the mock's cycle counter for the whole frame
+      // time, so fewer are run.
+      MockHal::reset();
+      timeParallel(pixelCount, frames / 10 + 1);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  int frames = argc > 1 ? atoi(argv[1]) : 1000;
+
+  int failures = 0;
+  int checks = 0;
+
+  for (size_t t = 0; t < sizeof(NEO_TYPES) / sizeof(NEO_TYPES[0]); t++) {
+    for (size_t c = 0; c < sizeof(PIXEL_COUNTS) / sizeof(PIXEL_COUNTS[0]);
+         c++) {
+      failures += checkNeoSpi(NEO_TYPES[t], PIXEL_COUNTS[c], 20);
+      checks++;
+    }
+  }
+  printf("neo-spi: %d cases decoded, %d failures\n", checks, failures);
+
+  int parallelFailures = 0;
+  for (size_t t = 0; t < sizeof(NEO_TYPES) / sizeof(NEO_TYPES[0]); t++) {
+    parallelFailures += checkParallel(NEO_TYPES[t]);
+  }
+  printf("parallel-neo: %d types decoded, %d failures\n",
+         (int)(sizeof(NEO_TYPES) / sizeof(NEO_TYPES[0])), parallelFailures);
+  failures += parallelFailures;
+
+  int busFailures = checkBuses();
+  printf("spi-buses: %d failures\n", busFailures);
+  failures += busFailures;
+
+  int fixedFailures = checkFixedStrips();
+  printf("fixed: %d failures\n", fixedFailures);
+  failures += fixedFailures;
+
+  timing(frames);
+
+  return failures ? 1 : 0;
+}
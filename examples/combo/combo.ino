@@ -22,6 +22,9 @@ Pattern stripPattern(&stripRgb, "strip");
 NeoStrip ringRgb(16, D2, WS2812B);
 Pattern ringPattern(&ringRgb, "ring");
 
+// Draws both patterns, only when they need it.
+PatternScheduler scheduler;
+
 int setStripPattern(String text) {
   stripPattern.setPattern(stringToPattern(text));
   return 0;
@@ -32,24 +35,31 @@ int setRingPattern(String text) {
   return 0;
 }
 
+void publishStripPattern(Pattern* pattern) {
+  String patternText = patternToString(pattern->getPattern());
+  Spark.publish("strip", patternText, 60, PRIVATE);
+}
+
+void publishRingPattern(Pattern* pattern) {
+  String patternText = patternToString(pattern->getPattern());
+  Spark.publish("ring", patternText, 60, PRIVATE);
+}
+
 void setup()
 {
   stripPattern.setPattern(TEST, RED, BLACK, 1000);
   ringPattern.setPattern(TEST, RED, GREEN, 1000);
 
+  scheduler.add(&stripPattern, publishStripPattern);
+  scheduler.add(&ringPattern, publishRingPattern);
+
   Spark.function("strip_target", setStripPattern);
   Spark.function("ring_target", setRingPattern);
 }
 
 void loop()
 {
-  if (stripPattern.drawUpdate()) {
-    String patternText = patternToString(stripPattern.getPattern());
-    Spark.publish("strip", patternText, 60, PRIVATE);
-  }
-
-  if (ringPattern.drawUpdate()) {
-    String patternText = patternToString(ringPattern.getPattern());
-    Spark.publish("ring", patternText, 60, PRIVATE);
-  }
+  // Draw whichever patterns are due, then wait until the next one is. The
+  // cloud connection is still serviced while waiting.
+  delay(scheduler.drawUpdate());
 }
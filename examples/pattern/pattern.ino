@@ -37,7 +37,7 @@ void advancePattern() {
 
     case 3:
       // Pulse RANDOM color each pulse. Pulses last 400ms.
-      pattern.setPattern(PULSE, RANDOM, BLACK, 10);
+      pattern.setPattern(PULSE, RANDOM, BLACK, 400);
       break;
 
     case 4:
@@ -66,7 +66,10 @@ void loop() {
   }
 
   // Redraw strip, with current animation state (if needed).
-  pattern.drawUpdate();
-
-  String patternText = patternToString(pattern.getPattern());
+  if (pattern.drawUpdate()) {
+    // Publish the new pattern, formatted without allocating.
+    char patternText[PATTERN_TEXT_SIZE];
+    formatPattern(pattern.getPattern(), patternText, sizeof(patternText));
+    Spark.publish("pattern", patternText, 60, PRIVATE);
+  }
 }
@@ -0,0 +1,376 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+#ifndef HOST_APPLICATION_H
+#define HOST_APPLICATION_H
+
+//
+// Host stand in for the Particle <application.h> header.
+//
+// Provides just enough of the Wiring API (String, SPI, GPIO, PWM, time, random
+// and the cloud calls used by the examples) for the library to build and run
+// on a workstation. Everything is backed by the mock HAL in mock-hal.h, which
+// records the hardware traffic and drives a virtual clock.
+//
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <string>
+
+//
+// Arduino String.
+//
+
+#define DEC (10)
+#define HEX (16)
+
+class String {
+  public:
+    inline String() {}
+    inline String(const char* text) : value(text ? text : "") {}
+    inline String(const std::string& text) : value(text) {}
+    inline explicit String(char c) : value(1, c) {}
+    inline String(unsigned char number, unsigned char base=DEC) {
+      this->fromNumber(number, base);
+    }
+    inline String(int number, unsigned char base=DEC) {
+      this->fromNumber(number, base);
+    }
+    inline String(unsigned int number, unsigned char base=DEC) {
+      this->fromNumber(number, base);
+    }
+    inline String(long number, unsigned char base=DEC) {
+      this->fromNumber(number, base);
+    }
+    inline String(unsigned long number, unsigned char base=DEC) {
+      this->fromNumber(number, base);
+    }
+
+    inline unsigned int length() const { return this->value.length(); }
+    inline const char* c_str() const { return this->value.c_str(); }
+
+    inline String substring(unsigned int left) const {
+      return this->substring(left, this->length());
+    }
+
+    inline String substring(unsigned int left, unsigned int right) const {
+      if (left > right) {
+        unsigned int temp = left;
+        left = right;
+        right = temp;
+      }
+      if (left >= this->length())
+        return String();
+      if (right > this->length())
+        right = this->length();
+      return String(this->value.substr(left, right - left));
+    }
+
+    inline int indexOf(char c, unsigned int fromIndex=0) const {
+      size_t found = this->value.find(c, fromIndex);
+      return found == std::string::npos ? -1 : (int)found;
+    }
+
+    inline void toUpperCase() {
+      for (size_t i = 0; i < this->value.length(); i++) {
+        if (this->value[i] >= 'a' && this->value[i] <= 'z')
+          this->value[i] = this->value[i] - 'a' + 'A';
+      }
+    }
+
+    inline bool operator ==(const String& other) const {
+      return this->value == other.value;
+    }
+    inline bool operator ==(const char* other) const {
+      return this->value == other;
+    }
+    inline bool operator !=(const String& other) const {
+      return !(*this == other);
+    }
+    inline bool operator !=(const char* other) const {
+      return !(*this == other);
+    }
+
+    inline String& operator +=(const String& other) {
+      this->value += other.value;
+      return *this;
+    }
+
+    inline friend String operator +(const String& left, const String& right) {
+      return String(left.value + right.value);
+    }
+    inline friend String operator +(const String& left, const char* right) {
+      return String(left.value + right);
+    }
+    inline friend String operator +(const char* left, const String& right) {
+      return String(left + right.value);
+    }
+    inline friend String operator +(const String& left, char right) {
+      return String(left.value + right);
+    }
+    inline friend String operator +(const String& left, int right) {
+      return left + String(right);
+    }
+
+  private:
+    template<typename T>
+    inline void fromNumber(T number, unsigned char base) {
+      bool negative = number < 0;
+      unsigned long magnitude =
+          negative ? 0UL - (unsigned long)number : (unsigned long)number;
+
+      char digits[sizeof(unsigned long) * 8 + 2];
+      char* cursor = digits + sizeof(digits);
+      *--cursor = '\0';
+      do {
+        int digit = magnitude % base;
+        *--cursor = digit < 10 ? '0' + digit : 'a' + digit - 10;
+        magnitude /= base;
+      } while (magnitude);
+
+      if (negative)
+        *--cursor = '-';
+
+      this->value = cursor;
+    }
+
+    std::string value;
+};
+
+//
+// Time.
+//
+
+typedef uint32_t system_tick_t;
+
+system_tick_t millis();
+system_tick_t micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+//
+// Random. Matches the Wiring semantics, but is deterministic per seed.
+//
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned int seed);
+
+//
+// GPIO and PWM.
+//
+
+typedef uint16_t pin_t;
+
+typedef enum {
+  INPUT,
+  OUTPUT,
+  INPUT_PULLUP,
+  INPUT_PULLDOWN,
+} PinMode;
+
+#define LOW  (0)
+#define HIGH (1)
+
+#define D0 (0)
+#define D1 (1)
+#define D2 (2)
+#define D3 (3)
+#define D4 (4)
+#define D5 (5)
+#define D6 (6)
+#define D7 (7)
+#define A0 (10)
+#define A1 (11)
+#define A2 (12)
+#define A3 (13)
+#define A4 (14)
+#define A5 (15)
+#define A6 (16)
+#define A7 (17)
+
+#define TOTAL_PINS (24)
+
+void pinMode(pin_t pin, PinMode mode);
+void digitalWrite(pin_t pin, uint8_t value);
+int32_t digitalRead(pin_t pin);
+void analogWrite(pin_t pin, int32_t value);
+
+//
+// GPIO port registers and pin map, as on the Photon's STM32F2. Writing a mask
+// to BSRRL sets those pins of the port, and to BSRRH clears them, all at
+// once. BSRR and BRR do the same, as on the Core's STM32F1 (built with
+// PLATFORM_ID 0). Only D0-D7 and A0-A7 are mapped.
+//
+
+class GPIOPortRegister {
+  public:
+    inline GPIOPortRegister(int port, bool set) : port(port), set(set) {}
+
+    GPIOPortRegister& operator=(uint16_t mask);
+
+  private:
+    int port;
+    bool set;
+};
+
+typedef struct GPIO_TypeDef {
+  inline GPIO_TypeDef(int port) :
+      BSRRL(port, true), BSRRH(port, false),
+      BSRR(port, true), BRR(port, false) {}
+
+  GPIOPortRegister BSRRL;
+  GPIOPortRegister BSRRH;
+  GPIOPortRegister BSRR;
+  GPIOPortRegister BRR;
+} GPIO_TypeDef;
+
+typedef struct STM32_Pin_Info {
+  GPIO_TypeDef* gpio_peripheral;
+  uint16_t gpio_pin;
+} STM32_Pin_Info;
+
+STM32_Pin_Info* HAL_Pin_Map();
+
+//
+// Cycle counter and interrupts.
+//
+
+class SystemClass {
+  public:
+    // Each read of the cycle counter takes a few ns of virtual time, so
+    // busy waits on it finish.
+    uint32_t ticks();
+    inline uint32_t ticksPerMicrosecond() { return 120; }
+};
+
+extern SystemClass System;
+
+void noInterrupts();
+void interrupts();
+
+//
+// Threads. Each Thread runs on a std::thread. The mock HAL itself isn't
+// thread safe, so only one thread at a time should use it.
+//
+
+#define PLATFORM_THREADING (1)
+
+typedef void os_thread_return_t;
+typedef os_thread_return_t (*os_thread_fn_t)(void* param);
+typedef uint8_t os_thread_prio_t;
+typedef void* os_thread_t;
+typedef int os_result_t;
+
+#define OS_THREAD_PRIORITY_DEFAULT (2)
+#define OS_THREAD_STACK_SIZE_DEFAULT (3 * 1024)
+
+class Thread {
+  public:
+    Thread(const char* name, os_thread_fn_t function, void* function_param=NULL,
+           os_thread_prio_t priority=OS_THREAD_PRIORITY_DEFAULT,
+           size_t stack_size=OS_THREAD_STACK_SIZE_DEFAULT);
+    ~Thread();
+
+    bool join();
+    inline bool isValid() const { return this->handle != NULL; }
+
+  private:
+    Thread(const Thread&);
+    Thread& operator=(const Thread&);
+
+    void* handle;
+};
+
+// Advances the virtual clock by 1us, so a thread yielding while it waits for
+// a deadline sees time pass.
+void os_thread_yield();
+
+// Does nothing. The std::thread ends when its function returns.
+os_result_t os_thread_exit(os_thread_t thread);
+
+//
+// SPI.
+//
+
+#define MSBFIRST (1)
+#define LSBFIRST (0)
+
+#define SPI_MODE0 (0x00)
+#define SPI_MODE1 (0x01)
+#define SPI_MODE2 (0x02)
+#define SPI_MODE3 (0x03)
+
+#define HZ  (1)
+#define KHZ (1000)
+#define MHZ (1000000)
+
+typedef void (*wiring_spi_dma_transfercomplete_callback_t)(void);
+
+class SPIClass {
+  public:
+    inline SPIClass(int bus) : bus(bus) {}
+
+    void begin();
+    void end();
+    void setBitOrder(uint8_t order);
+    void setDataMode(uint8_t mode);
+    void setClockSpeed(unsigned value, unsigned value_scale=HZ);
+
+    uint8_t transfer(uint8_t data);
+
+    // Bulk transfer. Without a callback, this blocks until complete.
+    void transfer(void* tx_buffer, void* rx_buffer, size_t length,
+                  wiring_spi_dma_transfercomplete_callback_t user_callback);
+
+    int getBus() const { return this->bus; }
+
+  private:
+    int bus;
+};
+
+extern SPIClass SPI;
+extern SPIClass SPI1;
+
+#define Wiring_SPI1 (1)
+
+//
+// Cloud.
+//
+
+typedef enum {
+  PUBLIC,
+  PRIVATE,
+} Spark_Event_TypeDef;
+
+class CloudClass {
+  public:
+    bool function(const char* name, int (*call)(String));
+    bool publish(const char* name, const String& data, int ttl=60,
+                 Spark_Event_TypeDef type=PUBLIC);
+};
+
+extern CloudClass Spark;
+extern CloudClass Particle;
+
+#endif
@@ -0,0 +1,60 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+//
+// Runs a library example (.ino sketch) on the host against the mock HAL.
+//
+// The sketch to run is selected at build time with INO_FILE. The virtual clock
+// advances one millisecond per loop() pass (plus any time the sketch spends in
+// delay()), for the number of simulated seconds given on the command line
+// (default 60).
+//
+//   combo-host 10
+//
+
+#include <stdio.h>
+
+#include "mock-hal.h"
+#include INO_FILE
+
+int main(int argc, char** argv) {
+  unsigned long seconds = argc > 1 ? strtoul(argv[1], NULL, 10) : 60;
+
+  MockHal::reset();
+
+  setup();
+
+  unsigned long long end = seconds * 1000000ULL;
+  unsigned long loops = 0;
+  while (MockHal::now() < end) {
+    loop();
+    MockHal::advanceMillis(1);
+    loops++;
+  }
+
+  const MockHal::Counters& counters = MockHal::counters();
+  printf("simulated:      %lu s\n", seconds);
+  printf("loop passes:    %lu\n", loops);
+  printf("spi bytes:      %llu\n", counters.spiBytes);
+  printf("neopixel bytes: %llu\n", counters.neoPixelBytes);
+  printf("pwm writes:     %llu\n", counters.analogWrites);
+  printf("publishes:      %llu\n", counters.publishes);
+
+  return 0;
+}
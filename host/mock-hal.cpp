@@ -0,0 +1,454 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+#include <map>
+#include <string>
+#include <thread>
+
+#include "mock-hal.h"
+
+namespace {
+  // Kept in nanoseconds, so short SPI transfers can advance it.
+  unsigned long long clockNanos = 0;
+  unsigned long randomState = 1;
+  bool recording = false;
+
+  MockHal::Counters traffic;
+
+  std::vector<uint8_t> spiLog[2];
+  std::vector<MockHal::PinWrite> pinLog;
+  int32_t pinState[TOTAL_PINS];
+
+  // GPIO ports, as on the Photon.
+  const int PORT_COUNT = 3;
+  GPIO_TypeDef ports[PORT_COUNT] = { GPIO_TypeDef(0), GPIO_TypeDef(1),
+                                     GPIO_TypeDef(2) };
+  uint16_t portStates[PORT_COUNT];
+  std::vector<MockHal::PortWrite> portLog;
+
+  STM32_Pin_Info pinMap[TOTAL_PINS] = {
+    { &ports[1], 1 << 7 },   // D0 PB7
+    { &ports[1], 1 << 6 },   // D1 PB6
+    { &ports[1], 1 << 5 },   // D2 PB5
+    { &ports[1], 1 << 4 },   // D3 PB4
+    { &ports[1], 1 << 3 },   // D4 PB3
+    { &ports[0], 1 << 15 },  // D5 PA15
+    { &ports[0], 1 << 14 },  // D6 PA14
+    { &ports[0], 1 << 13 },  // D7 PA13
+    { NULL, 0 },
+    { NULL, 0 },
+    { &ports[2], 1 << 5 },   // A0 PC5
+    { &ports[2], 1 << 3 },   // A1 PC3
+    { &ports[2], 1 << 2 },   // A2 PC2
+    { &ports[0], 1 << 5 },   // A3 PA5
+    { &ports[0], 1 << 6 },   // A4 PA6
+    { &ports[0], 1 << 7 },   // A5 PA7
+    { &ports[0], 1 << 4 },   // A6 PA4
+    { &ports[0], 1 << 0 },   // A7 PA0
+  };
+
+  // Cycle counter rate, and the virtual time each read of it takes.
+  const unsigned TICKS_PER_MICROSECOND = 120;
+  const unsigned long long TICK_READ_NANOS = 8;
+
+  bool interruptsOff = false;
+  unsigned long long interruptsOffAt = 0;
+  unsigned long long interruptsOffTotal = 0;
+
+  std::map<pin_t, std::vector<uint8_t> > neoPixelLog;
+  std::map<std::string, String> publishLog;
+  std::map<std::string, int (*)(String)> functions;
+
+  // An in progress DMA transfer on each bus.
+  struct SpiTransfer {
+    bool pending;
+    unsigned long long doneAt;
+    wiring_spi_dma_transfercomplete_callback_t callback;
+  };
+
+  const unsigned DEFAULT_SPI_CLOCK = 8 * MHZ;
+
+  // Peripheral clock each bus divides down, as on the Photon (SPI on APB2,
+  // SPI1 on APB1), or the Core with PLATFORM_ID 0.
+#if defined(PLATFORM_ID) && PLATFORM_ID == 0
+  const unsigned SPI_REFERENCE_CLOCK[2] = { 72 * MHZ, 36 * MHZ };
+#else
+  const unsigned SPI_REFERENCE_CLOCK[2] = { 60 * MHZ, 30 * MHZ };
+#endif
+
+  unsigned spiClock[2] = { DEFAULT_SPI_CLOCK, DEFAULT_SPI_CLOCK };
+  SpiTransfer spiTransfer[2];
+
+  // Time taken to clock a number of bytes out of a bus.
+  inline unsigned long long spiNanos(int bus, size_t length) {
+    return length * 8ULL * 1000000000ULL / spiClock[bus];
+  }
+
+  // Complete any DMA transfers that are finished at the current time.
+  inline void serviceSpi() {
+    for (int bus = 0; bus < 2; bus++) {
+      SpiTransfer& transfer = spiTransfer[bus];
+      if (transfer.pending && transfer.doneAt <= clockNanos) {
+        transfer.pending = false;
+        transfer.callback();
+      }
+    }
+  }
+
+  inline void recordPin(pin_t pin, int32_t value) {
+    if (pin < TOTAL_PINS)
+      pinState[pin] = value;
+
+    if (recording) {
+      MockHal::PinWrite write = { clockNanos / 1000, pin, value };
+      pinLog.push_back(write);
+    }
+  }
+}
+
+//
+// Mock HAL control.
+//
+
+namespace MockHal {
+
+  void reset() {
+    clockNanos = 0;
+    recording = false;
+    spiClock[0] = spiClock[1] = DEFAULT_SPI_CLOCK;
+    memset(spiTransfer, 0, sizeof(spiTransfer));
+    memset(&traffic, 0, sizeof(traffic));
+    memset(pinState, 0, sizeof(pinState));
+    memset(portStates, 0, sizeof(portStates));
+    portLog.clear();
+    interruptsOff = false;
+    interruptsOffTotal = 0;
+    spiLog[0].clear();
+    spiLog[1].clear();
+    pinLog.clear();
+    neoPixelLog.clear();
+    publishLog.clear();
+    randomSeed(1);
+  }
+
+  unsigned long long now() { return clockNanos / 1000; }
+
+  void setMicros(unsigned long long micros) {
+    clockNanos = micros * 1000;
+    serviceSpi();
+  }
+
+  void advanceNanos(unsigned long long nanos) {
+    clockNanos += nanos;
+    serviceSpi();
+  }
+
+  void advanceMicros(unsigned long long micros) {
+    advanceNanos(micros * 1000);
+  }
+
+  void advanceMillis(unsigned long ms) {
+    advanceNanos(ms * 1000000ULL);
+  }
+
+  bool spiBusy(int bus) { return spiTransfer[bus].pending; }
+
+  unsigned spiClockSpeed(int bus) { return spiClock[bus]; }
+
+  void setRecording(bool enabled) { recording = enabled; }
+
+  const Counters& counters() { return traffic; }
+
+  const std::vector<uint8_t>& spiBytes(int bus) { return spiLog[bus]; }
+
+  void clearSpiBytes() {
+    spiLog[0].clear();
+    spiLog[1].clear();
+  }
+
+  const std::vector<PinWrite>& pinWrites() { return pinLog; }
+  void clearPinWrites() { pinLog.clear(); }
+
+  int32_t pinValue(pin_t pin) {
+    return pin < TOTAL_PINS ? pinState[pin] : 0;
+  }
+
+  const std::vector<PortWrite>& portWrites() { return portLog; }
+  void clearPortWrites() { portLog.clear(); }
+
+  uint16_t portState(int port) {
+    return port < PORT_COUNT ? portStates[port] : 0;
+  }
+
+  unsigned long long interruptsOffNanos() {
+    return interruptsOffTotal +
+        (interruptsOff ? clockNanos - interruptsOffAt : 0);
+  }
+
+  const std::vector<uint8_t>& neoPixelBytes(pin_t pin) {
+    return neoPixelLog[pin];
+  }
+
+  void recordNeoPixelShow(pin_t pin, const uint8_t* data, size_t length) {
+    traffic.neoPixelShows++;
+    traffic.neoPixelBytes += length;
+
+    if (recording)
+      neoPixelLog[pin].insert(neoPixelLog[pin].end(), data, data + length);
+  }
+
+  String lastPublish(const char* name) {
+    return publishLog[name];
+  }
+
+  int callFunction(const char* name, const String& argument) {
+    std::map<std::string, int (*)(String)>::iterator found =
+        functions.find(name);
+    return found == functions.end() ? -1 : found->second(argument);
+  }
+}
+
+//
+// Time.
+//
+
+system_tick_t millis() { return (system_tick_t)(clockNanos / 1000000); }
+system_tick_t micros() { return (system_tick_t)(clockNanos / 1000); }
+void delay(unsigned long ms) { MockHal::advanceMillis(ms); }
+void delayMicroseconds(unsigned int us) { MockHal::advanceMicros(us); }
+
+//
+// Random. A small LCG, so results don't depend on the host libc.
+//
+
+long random(long howbig) {
+  if (howbig == 0)
+    return 0;
+
+  randomState = randomState * 1103515245UL + 12345UL;
+  return (long)((randomState >> 16) & 0x7FFFFFFF) % howbig;
+}
+
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig)
+    return howsmall;
+
+  return random(howbig - howsmall) + howsmall;
+}
+
+void randomSeed(unsigned int seed) {
+  randomState = seed;
+}
+
+//
+// GPIO and PWM.
+//
+
+void pinMode(pin_t pin, PinMode mode) {}
+
+void digitalWrite(pin_t pin, uint8_t value) {
+  traffic.digitalWrites++;
+  recordPin(pin, value);
+
+  if (pin < TOTAL_PINS && pinMap[pin].gpio_peripheral) {
+    int port = pinMap[pin].gpio_peripheral - ports;
+    if (value)
+      portStates[port] |= pinMap[pin].gpio_pin;
+    else
+      portStates[port] &= ~pinMap[pin].gpio_pin;
+  }
+}
+
+GPIOPortRegister& GPIOPortRegister::operator=(uint16_t mask) {
+  traffic.portWrites++;
+
+  uint16_t& state = portStates[this->port];
+  state = this->set ? (state | mask) : (state & ~mask);
+
+  for (pin_t pin = 0; pin < TOTAL_PINS; pin++) {
+    if (pinMap[pin].gpio_peripheral == &ports[this->port] &&
+        (pinMap[pin].gpio_pin & mask)) {
+      pinState[pin] = (state & pinMap[pin].gpio_pin) ? HIGH : LOW;
+    }
+  }
+
+  if (recording) {
+    MockHal::PortWrite write = { clockNanos, this->port, state };
+    portLog.push_back(write);
+  }
+
+  return *this;
+}
+
+STM32_Pin_Info* HAL_Pin_Map() {
+  return pinMap;
+}
+
+//
+// Cycle counter and interrupts.
+//
+
+SystemClass System;
+
+uint32_t SystemClass::ticks() {
+  MockHal::advanceNanos(TICK_READ_NANOS);
+  return clockNanos * TICKS_PER_MICROSECOND / 1000;
+}
+
+void noInterrupts() {
+  if (!interruptsOff) {
+    interruptsOff = true;
+    interruptsOffAt = clockNanos;
+  }
+}
+
+void interrupts() {
+  if (interruptsOff) {
+    interruptsOff = false;
+    interruptsOffTotal += clockNanos - interruptsOffAt;
+  }
+}
+
+int32_t digitalRead(pin_t pin) {
+  return MockHal::pinValue(pin);
+}
+
+void analogWrite(pin_t pin, int32_t value) {
+  traffic.analogWrites++;
+  recordPin(pin, value);
+}
+
+//
+// Threads.
+//
+
+Thread::Thread(const char* name, os_thread_fn_t function, void* function_param,
+               os_thread_prio_t priority, size_t stack_size) :
+    handle(new std::thread(function, function_param)) {}
+
+Thread::~Thread() {
+  std::thread* thread = (std::thread*)this->handle;
+  if (thread && thread->joinable())
+    thread->detach();
+  delete thread;
+}
+
+bool Thread::join() {
+  std::thread* thread = (std::thread*)this->handle;
+  if (!thread || !thread->joinable())
+    return false;
+
+  thread->join();
+  return true;
+}
+
+void os_thread_yield() {
+  MockHal::advanceMicros(1);
+}
+
+os_result_t os_thread_exit(os_thread_t thread) {
+  return 0;
+}
+
+//
+// SPI.
+//
+
+SPIClass SPI(0);
+SPIClass SPI1(1);
+
+void SPIClass::begin() {}
+void SPIClass::end() {}
+void SPIClass::setBitOrder(uint8_t order) {}
+void SPIClass::setDataMode(uint8_t mode) {}
+
+// Like the HAL, divide the bus's reference clock by the smallest power of
+// two from 2 to 256 that doesn't exceed the requested speed.
+void SPIClass::setClockSpeed(unsigned value, unsigned value_scale) {
+  unsigned clock = SPI_REFERENCE_CLOCK[this->bus] / 2;
+  for (int divider = 2; divider < 256 && clock > value * value_scale;
+       divider *= 2) {
+    clock /= 2;
+  }
+  spiClock[this->bus] = clock;
+}
+
+uint8_t SPIClass::transfer(uint8_t data) {
+  MockHal::advanceNanos(spiNanos(this->bus, 1));
+
+  traffic.spiBytes++;
+  traffic.spiTransfers++;
+
+  if (recording)
+    spiLog[this->bus].push_back(data);
+
+  return 0;
+}
+
+void SPIClass::transfer(void* tx_buffer, void* rx_buffer, size_t length,
+                        wiring_spi_dma_transfercomplete_callback_t user_callback) {
+  traffic.spiBytes += length;
+  traffic.spiTransfers++;
+
+  if (recording && tx_buffer) {
+    const uint8_t* tx = (const uint8_t*)tx_buffer;
+    spiLog[this->bus].insert(spiLog[this->bus].end(), tx, tx + length);
+  }
+
+  if (rx_buffer)
+    memset(rx_buffer, 0, length);
+
+  // The bus can only run one transfer at a time.
+  SpiTransfer& transfer = spiTransfer[this->bus];
+  if (transfer.pending) {
+    if (transfer.doneAt > clockNanos)
+      clockNanos = transfer.doneAt;
+    serviceSpi();
+  }
+
+  // Without a callback, block for the transfer time. Otherwise, complete
+  // in the background once the clock passes the transfer time.
+  if (!user_callback) {
+    MockHal::advanceNanos(spiNanos(this->bus, length));
+    return;
+  }
+
+  transfer.pending = true;
+  transfer.doneAt = clockNanos + spiNanos(this->bus, length);
+  transfer.callback = user_callback;
+}
+
+//
+// Cloud.
+//
+
+CloudClass Spark;
+CloudClass Particle;
+
+bool CloudClass::function(const char* name, int (*call)(String)) {
+  functions[name] = call;
+  return true;
+}
+
+bool CloudClass::publish(const char* name, const String& data, int ttl,
+                         Spark_Event_TypeDef type) {
+  traffic.publishes++;
+  publishLog[name] = data;
+  return true;
+}
@@ -0,0 +1,120 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+#ifndef HOST_MOCK_HAL_H
+#define HOST_MOCK_HAL_H
+
+#include <vector>
+
+#include "application.h"
+
+//
+// Control and inspection interface for the host mock HAL.
+//
+// The clock never advances by itself. Benchmarks and host runners move it
+// explicitly, so pattern timing is fully reproducible. The only exceptions
+// are the blocking calls that take time on a device: delay(), SPI transfers
+// (at the bus clock speed), and reads of the cycle counter (so busy waits on
+// System.ticks() end). Hardware traffic is always counted; the individual
+// bytes and writes are only kept while recording is enabled, so long
+// benchmark runs don't grow without bound.
+//
+
+namespace MockHal {
+
+  // A single GPIO or PWM write.
+  struct PinWrite {
+    unsigned long long micros;
+    pin_t pin;
+    int32_t value;
+  };
+
+  // The state of a GPIO port after a write to its registers.
+  struct PortWrite {
+    unsigned long long nanos;
+    int port;
+    uint16_t state;
+  };
+
+  // Traffic counters since the last reset().
+  struct Counters {
+    unsigned long long spiBytes;
+    unsigned long long spiTransfers;
+    unsigned long long digitalWrites;
+    unsigned long long portWrites;
+    unsigned long long analogWrites;
+    unsigned long long neoPixelBytes;
+    unsigned long long neoPixelShows;
+    unsigned long long publishes;
+  };
+
+  // Restore power on state: clock at zero, counters and logs cleared,
+  // recording disabled, random reseeded.
+  void reset();
+
+  // Virtual clock.
+  unsigned long long now();
+  void setMicros(unsigned long long micros);
+  void advanceNanos(unsigned long long nanos);
+  void advanceMicros(unsigned long long micros);
+  void advanceMillis(unsigned long ms);
+
+  // Is a DMA transfer in progress on a bus. A transfer started with a
+  // completion callback runs in the background for the time it takes to
+  // clock out its bytes, and calls back when the clock passes that point.
+  bool spiBusy(int bus=0);
+
+  // Clock speed set on a bus, in Hz.
+  unsigned spiClockSpeed(int bus=0);
+
+  // Recording of bytes and pin writes.
+  void setRecording(bool enabled);
+
+  const Counters& counters();
+
+  // Bytes sent on a bus (0 for SPI, 1 for SPI1) while recording.
+  const std::vector<uint8_t>& spiBytes(int bus=0);
+  void clearSpiBytes();
+
+  // Pin writes while recording, and the last value written to each pin.
+  const std::vector<PinWrite>& pinWrites();
+  void clearPinWrites();
+  int32_t pinValue(pin_t pin);
+
+  // GPIO port register writes while recording, and the state of each port
+  // (0 for GPIOA, 1 for GPIOB, 2 for GPIOC).
+  const std::vector<PortWrite>& portWrites();
+  void clearPortWrites();
+  uint16_t portState(int port);
+
+  // Nanoseconds interrupts have been disabled for.
+  unsigned long long interruptsOffNanos();
+
+  // Bytes shown by NeoPixel strips on a pin while recording.
+  const std::vector<uint8_t>& neoPixelBytes(pin_t pin);
+  void recordNeoPixelShow(pin_t pin, const uint8_t* data, size_t length);
+
+  // Last value published to each event.
+  String lastPublish(const char* name);
+
+  // Invoke a function registered with Spark.function.
+  int callFunction(const char* name, const String& argument);
+}
+
+#endif
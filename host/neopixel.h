@@ -0,0 +1,95 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+#ifndef HOST_NEOPIXEL_H
+#define HOST_NEOPIXEL_H
+
+#include "mock-hal.h"
+
+//
+// Host stand in for the Particle NeoPixel library.
+//
+// Keeps the same pixel array and color ordering as the real library, and hands
+// the array to the mock HAL on each show() instead of bit banging a pin.
+//
+
+#define WS2812   (0x00) // Also WS2811, 800 KHz
+#define WS2812B  (0x02)
+#define WS2811   (0x00)
+#define TM1803   (0x03) // 400 KHz
+#define TM1829   (0x04)
+#define WS2812B2 (0x05)
+
+class Adafruit_NeoPixel {
+  public:
+    inline Adafruit_NeoPixel(uint16_t n, uint8_t p=2, uint8_t t=WS2812B) :
+        numLEDs(n), numBytes(n * 3), pin(p), type(t),
+        pixels((uint8_t*)calloc(n * 3, 1)) {}
+
+    inline ~Adafruit_NeoPixel() {
+      free(this->pixels);
+    }
+
+    inline void begin() {
+      pinMode(this->pin, OUTPUT);
+      digitalWrite(this->pin, LOW);
+    }
+
+    inline void show() {
+      MockHal::recordNeoPixelShow(this->pin, this->pixels, this->numBytes);
+    }
+
+    inline void setColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
+      if (n >= this->numLEDs)
+        return;
+
+      uint8_t* p = &this->pixels[n * 3];
+      switch (this->type) {
+        case WS2812B:
+        case WS2812B2:
+        case WS2812:
+          *p++ = g;
+          *p++ = r;
+          *p = b;
+          break;
+        case TM1829:
+          *p++ = r;
+          *p++ = b;
+          *p = g;
+          break;
+        default:
+          *p++ = r;
+          *p++ = g;
+          *p = b;
+          break;
+      }
+    }
+
+    inline uint8_t* getPixels() const { return this->pixels; }
+    inline uint16_t numPixels() const { return this->numLEDs; }
+
+  private:
+    uint16_t numLEDs;
+    uint16_t numBytes;
+    uint8_t pin;
+    uint8_t type;
+    uint8_t* pixels;
+};
+
+#endif
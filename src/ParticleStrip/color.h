@@ -95,29 +95,164 @@ inline Color expandSpecial(Color color) {
   return color;
 }
 
-// 0 left, 1.0 right. Rounding errors are possible.
-inline Color mixColor(Color left, Color right, float ratio) {
+//
+// Fixed point color math.
+//
+// Ratios are 8.8 fixed point, from 0 (all left) to RATIO_ONE (all right).
+// Results are rounded to the nearest shade, and the end points are exact.
+//
+
+typedef uint16_t ColorRatio;
+
+#define RATIO_ONE (256)
+
+// Convert a 0.0 - 1.0 ratio to fixed point, clamping to range.
+inline ColorRatio floatToRatio(float ratio) {
   if (ratio < 0.0)
     ratio = 0.0;
 
   if (ratio > 1.0)
     ratio = 1.0;
 
-  float l_ratio = 1.0 - ratio;
-  float r_ratio = ratio;
+  return (ColorRatio)(ratio * RATIO_ONE + 0.5);
+}
+
+inline uint8_t lerpShade(uint8_t left, uint8_t right, ColorRatio ratio) {
+  return (left * (RATIO_ONE - ratio) + right * ratio + 0x80) >> 8;
+}
 
+inline Color lerpColor(Color left, Color right, ColorRatio ratio) {
   Color result;
 
   result.special = 0;
-  result.red = (left.red * l_ratio) + (right.red * r_ratio);
-  result.green = (left.green * l_ratio) + (right.green * r_ratio);
-  result.blue = (left.blue * l_ratio) + (right.blue * r_ratio);
+  result.red = lerpShade(left.red, right.red, ratio);
+  result.green = lerpShade(left.green, right.green, ratio);
+  result.blue = lerpShade(left.blue, right.blue, ratio);
 
   return result;
 }
 
+inline Color scaleColor(Color color, ColorRatio scale) {
+  return lerpColor(BLACK, color, scale);
+}
+
+// Whole buffer versions work on a full Color per 32 bit word, two channels
+// at a time in 16 bit lanes (255 * RATIO_ONE + 0x80 never carries out of a
+// lane). Buffers may overlap exactly (mixBuffer(a, a, b, ...) is fine).
+
+inline uint32_t _lerpWord(uint32_t left, uint32_t right, ColorRatio ratio) {
+  uint32_t inverse = RATIO_ONE - ratio;
+
+  uint32_t even = ((left & 0x00FF00FF) * inverse +
+                   (right & 0x00FF00FF) * ratio +
+                   0x00800080) >> 8;
+  uint32_t odd = ((left >> 8) & 0x00FF00FF) * inverse +
+                 ((right >> 8) & 0x00FF00FF) * ratio +
+                 0x00800080;
+
+  return (even & 0x00FF00FF) | (odd & 0xFF00FF00);
+}
+
+inline uint32_t _scaleWord(uint32_t color, ColorRatio scale) {
+  uint32_t even = ((color & 0x00FF00FF) * scale + 0x00800080) >> 8;
+  uint32_t odd = ((color >> 8) & 0x00FF00FF) * scale + 0x00800080;
+
+  return (even & 0x00FF00FF) | (odd & 0xFF00FF00);
+}
+
+// Per channel min(left + right, 255). Bytes are added in 7 bits, with the top
+// bits and carries out worked out separately, and saturated through a mask.
+inline uint32_t _addWord(uint32_t left, uint32_t right) {
+  uint32_t sum = (left & 0x7F7F7F7F) + (right & 0x7F7F7F7F);
+  uint32_t carry = ((left & right) | ((left | right) & sum)) & 0x80808080;
+
+  sum ^= (left ^ right) & 0x80808080;
+  return sum | ((carry << 1) - (carry >> 7));
+}
+
+// Per channel max(left, right). Each 16 bit lane subtracts from a guard bit,
+// which is left set where left >= right.
+inline uint32_t _maxWord(uint32_t left, uint32_t right) {
+  uint32_t evenLeft = left & 0x00FF00FF;
+  uint32_t evenRight = right & 0x00FF00FF;
+  uint32_t even = ((evenLeft | 0x01000100) - evenRight) & 0x01000100;
+  even -= even >> 8;
+
+  uint32_t oddLeft = (left >> 8) & 0x00FF00FF;
+  uint32_t oddRight = (right >> 8) & 0x00FF00FF;
+  uint32_t odd = ((oddLeft | 0x01000100) - oddRight) & 0x01000100;
+  odd -= odd >> 8;
+
+  return (((evenLeft & even) | (evenRight & ~even)) & 0x00FF00FF) |
+         ((((oddLeft & odd) | (oddRight & ~odd)) & 0x00FF00FF) << 8);
+}
+
+// left * right / 255, rounded. Exact for 0 and 255.
+inline uint8_t multiplyShade(uint8_t left, uint8_t right) {
+  uint32_t product = left * right + 0x80;
+  return (product + (product >> 8)) >> 8;
+}
+
+// Per channel multiplyShade. Lanes can't be multiplied by lanes, so this
+// works a channel at a time.
+inline uint32_t _multiplyWord(uint32_t left, uint32_t right) {
+  Color l, r;
+  memcpy(&l, &left, sizeof(l));
+  memcpy(&r, &right, sizeof(r));
+
+  Color result = {0x00,
+                  multiplyShade(l.red, r.red),
+                  multiplyShade(l.green, r.green),
+                  multiplyShade(l.blue, r.blue)};
+
+  uint32_t word;
+  memcpy(&word, &result, sizeof(word));
+  return word;
+}
+
+// Word mask that clears the special byte, whatever the byte order.
+inline uint32_t _colorWordMask() {
+  static const Color mask = {0x00, 0xFF, 0xFF, 0xFF};
+  uint32_t word;
+  memcpy(&word, &mask, sizeof(word));
+  return word;
+}
+
+// result[i] = lerpColor(left[i], right[i], ratio)
+inline void mixBuffer(Color* result, const Color* left, const Color* right,
+                      int count, ColorRatio ratio) {
+  uint32_t mask = _colorWordMask();
+
+  for (int i = 0; i < count; i++) {
+    uint32_t l, r;
+    memcpy(&l, left + i, sizeof(l));
+    memcpy(&r, right + i, sizeof(r));
+
+    uint32_t mixed = _lerpWord(l, r, ratio) & mask;
+    memcpy(result + i, &mixed, sizeof(mixed));
+  }
+}
+
+// buffer[i] = scaleColor(buffer[i], scale)
+inline void scaleBuffer(Color* buffer, int count, ColorRatio scale) {
+  uint32_t mask = _colorWordMask();
+
+  for (int i = 0; i < count; i++) {
+    uint32_t color;
+    memcpy(&color, buffer + i, sizeof(color));
+
+    color = _scaleWord(color, scale) & mask;
+    memcpy(buffer + i, &color, sizeof(color));
+  }
+}
+
+// 0 left, 1.0 right.
+inline Color mixColor(Color left, Color right, float ratio) {
+  return lerpColor(left, right, floatToRatio(ratio));
+}
+
 inline Color dimColor(Color color, float brightness) {
-  return mixColor(BLACK, color, brightness);
+  return scaleColor(color, floatToRatio(brightness));
 };
 
 // Different effect from mixing. New color is one step towards target.
@@ -143,6 +278,25 @@ inline Color morphColor(Color base, Color target) {
   return result;
 }
 
+// Pack a color into 16 bits, 5/6/5 bits of red/green/blue.
+inline uint16_t colorToRgb565(Color color) {
+  return ((color.red & 0xF8) << 8) |
+         ((color.green & 0xFC) << 3) |
+         (color.blue >> 3);
+}
+
+// Unpack 5/6/5 bits, repeating the high bits so full scale stays full scale.
+inline Color rgb565ToColor(uint16_t packed) {
+  uint8_t red = packed >> 11;
+  uint8_t green = (packed >> 5) & 0x3F;
+  uint8_t blue = packed & 0x1F;
+
+  return Color{0x00,
+               (uint8_t)(red << 3 | red >> 2),
+               (uint8_t)(green << 2 | green >> 4),
+               (uint8_t)(blue << 3 | blue >> 2)};
+}
+
 // Invert a colors values (255 - color).
 inline Color invertColor(Color color) {
   Color result;
@@ -0,0 +1,330 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include "frame-strip.h"
+#include "patterns.h"
+
+//
+// Draws several patterns on one strip, as layers.
+//
+// Each layer draws into a frame buffer of its own (a FrameStrip). Whenever a
+// layer finishes a frame, the layers are combined, bottom to top, in a single
+// pass over the strip, and the strip is sent once. Frames from several layers
+// within one frame interval of the strip are shown together.
+//
+//   DotStrip dotRgb(60);
+//   Compositor compositor(&dotRgb);
+//
+//   void setup() {
+//     int background = compositor.addLayer();
+//     int eye = compositor.addLayer(BLEND_ADD);
+//     int status = compositor.addLayer(BLEND_OVER, false);
+//
+//     compositor.setPattern(background, LAVA, RED, BLACK, 400);
+//     compositor.setPattern(eye, CYLON, BLUE, BLACK, 2000);
+//     compositor.getCanvas(status)->setPixel(0, GREEN);
+//     compositor.getCanvas(status)->finishDraw();
+//   }
+//
+//   void loop() {
+//     compositor.drawUpdate();
+//   }
+//
+// Layers without a pattern are drawn directly, through getCanvas(). Changes
+// show on the next drawUpdate(). Setters return false, and getters NULL or a
+// default, for a layer that doesn't exist (eg -1 from a failed addLayer), or
+// a pattern call on a layer without one.
+//
+// Each layer has a blend mode, and an opacity it's mixed with the layers
+// below at. Words of a whole Color are combined at once, except for
+// BLEND_MULTIPLY, which works a channel at a time.
+//
+// It has the same interface as BasicPattern for drawing, so it can be used
+// with a BasicPatternScheduler. drawUpdate() returns true if any layer
+// switched pattern.
+//
+
+#define COMPOSITOR_MAX_LAYERS (4)
+
+// Pixels combined on the stack at a time, before they're stored in the strip.
+#define COMPOSITOR_RUN_PIXELS (32)
+
+typedef enum {
+  BLEND_OVER,      // Lit pixels replace the layers below. BLACK is clear.
+  BLEND_ADD,       // Channels add, up to full.
+  BLEND_MULTIPLY,  // Channels multiply, so WHITE is clear.
+  BLEND_MAX,       // The brighter of each channel.
+} BlendMode;
+
+template<typename StripT>
+class BasicCompositor {
+  public:
+    inline BasicCompositor(StripT* strip) :
+        strip(strip),
+        layerCount(0),
+        changed(false),
+        lastShow(micros() - strip->getFrameInterval()),
+        nextDraw(micros()) {}
+
+    inline ~BasicCompositor() {
+      for (int l = 0; l < this->layerCount; l++) {
+        delete this->layers[l].pattern;
+        delete this->layers[l].canvas;
+      }
+    }
+
+    // Add a layer on top of the others. If animated, it draws a pattern
+    // (SOLID BLACK to start with). Returns the layer, or -1 if there's no
+    // room for it.
+    inline int addLayer(BlendMode mode=BLEND_OVER, bool animated=true) {
+      if (this->layerCount >= COMPOSITOR_MAX_LAYERS)
+        return -1;
+
+      FrameStrip* canvas = new FrameStrip(this->strip->getPixelCount());
+      if (canvas->getPixelCount() != this->strip->getPixelCount()) {
+        delete canvas;
+        return -1;
+      }
+
+      // Patterns draw no faster than the strip can show.
+      unsigned long interval = this->strip->getFrameInterval();
+      canvas->setMaxFrameRate(interval ? 1000000 / interval : 0);
+
+      Layer& layer = this->layers[this->layerCount];
+      layer.canvas = canvas;
+      layer.pattern = animated ? new BasicPattern<FrameStrip>(canvas) : NULL;
+      layer.mode = mode;
+      layer.opacity = RATIO_ONE;
+
+      this->nextDraw = micros();
+      return this->layerCount++;
+    }
+
+    inline int getLayerCount() { return this->layerCount; }
+
+    inline bool setLayerMode(int layer, BlendMode mode) {
+      if (!this->hasLayer(layer))
+        return false;
+
+      this->layers[layer].mode = mode;
+      this->changed = true;
+      return true;
+    }
+
+    inline BlendMode getLayerMode(int layer) {
+      return this->hasLayer(layer) ? this->layers[layer].mode : BLEND_OVER;
+    }
+
+    // How much of the blended layer shows over the layers below, from 0
+    // (none) to RATIO_ONE (all).
+    inline bool setLayerOpacity(int layer, ColorRatio opacity) {
+      if (!this->hasLayer(layer))
+        return false;
+
+      this->layers[layer].opacity = opacity;
+      this->changed = true;
+      return true;
+    }
+
+    inline ColorRatio getLayerOpacity(int layer) {
+      return this->hasLayer(layer) ? this->layers[layer].opacity : 0;
+    }
+
+    // The frame buffer a layer draws into.
+    inline FrameStrip* getCanvas(int layer) {
+      return this->hasLayer(layer) ? this->layers[layer].canvas : NULL;
+    }
+
+    // The pattern of an animated layer, otherwise NULL.
+    inline BasicPattern<FrameStrip>* getLayerPattern(int layer) {
+      return this->hasLayer(layer) ? this->layers[layer].pattern : NULL;
+    }
+
+    // SOLID BLACK for a layer without a pattern.
+    inline PatternDescription getPattern(int layer) {
+      BasicPattern<FrameStrip>* pattern = this->getLayerPattern(layer);
+      return pattern ? pattern->getPattern() : PatternDescription();
+    }
+
+    inline bool setPattern(int layer,
+                           PatternType pattern, Color a, Color b, int speed) {
+      return this->setPattern(layer, PatternDescription(pattern, a, b, speed));
+    }
+
+    inline bool setPattern(int layer, const PatternDescription &next) {
+      BasicPattern<FrameStrip>* pattern = this->getLayerPattern(layer);
+      if (!pattern)
+        return false;
+
+      pattern->setPattern(next);
+      return true;
+    }
+
+    // micros() time at which the next frame is due.
+    inline system_tick_t getNextDraw() {
+      return this->nextDraw;
+    }
+
+    // Draw each layer that is due, and show the result if any changed.
+    inline bool drawUpdate() {
+      system_tick_t now = micros();
+      bool updated = false;
+
+      if ((int32_t)(now - this->nextDraw) >= 0) {
+        for (int l = 0; l < this->layerCount; l++) {
+          if (this->layers[l].pattern && this->layers[l].pattern->drawUpdate())
+            updated = true;
+        }
+        this->schedule(now);
+      }
+
+      for (int l = 0; l < this->layerCount; l++) {
+        if (this->layers[l].canvas->takeFrame())
+          this->changed = true;
+      }
+
+      if (!this->changed)
+        return updated;
+
+      // Layers draw at their own times, but the strip is sent no more often
+      // than its frame rate allows.
+      system_tick_t due = this->lastShow + this->strip->getFrameInterval();
+      if ((int32_t)(now - due) < 0) {
+        if ((int32_t)(due - this->nextDraw) < 0) {
+          this->nextDraw = due;
+        }
+        return updated;
+      }
+
+      this->composite();
+      this->strip->finishDraw();
+      this->changed = false;
+      this->lastShow = now;
+
+      return updated;
+    }
+
+  private:
+    BasicCompositor(const BasicCompositor&);
+    BasicCompositor& operator=(const BasicCompositor&);
+
+    typedef struct Layer {
+      FrameStrip* canvas;
+      BasicPattern<FrameStrip>* pattern;
+      BlendMode mode;
+      ColorRatio opacity;
+    } Layer;
+
+    inline bool hasLayer(int layer) {
+      return layer >= 0 && layer < this->layerCount;
+    }
+
+    // The earliest frame due on any layer.
+    inline void schedule(system_tick_t now) {
+      bool found = false;
+
+      for (int l = 0; l < this->layerCount; l++) {
+        if (!this->layers[l].pattern)
+          continue;
+
+        system_tick_t due = this->layers[l].pattern->getNextDraw();
+        if (!found || (int32_t)(due - this->nextDraw) < 0) {
+          this->nextDraw = due;
+          found = true;
+        }
+      }
+
+      // Nothing animated. Only drawn when a canvas changes.
+      if (!found) {
+        this->nextDraw = now + PATTERN_MAX_DELAY;
+      }
+    }
+
+    // Combine the layers into the strip, a pixel at a time. Runs of pixels
+    // are stored with setPixels(), which keeps the strip's power estimate up
+    // to date.
+    inline void composite() {
+      const Color* frames[COMPOSITOR_MAX_LAYERS];
+      for (int l = 0; l < this->layerCount; l++) {
+        frames[l] = this->layers[l].canvas->readPixelBuffer();
+      }
+
+      int pixelCount = this->strip->getPixelCount();
+      uint32_t mask = _colorWordMask();
+      Color run[COMPOSITOR_RUN_PIXELS];
+
+      for (int i = 0; i < pixelCount; i++) {
+        uint32_t result = 0;
+
+        for (int l = 0; l < this->layerCount; l++) {
+          const Layer& layer = this->layers[l];
+
+          uint32_t top;
+          memcpy(&top, frames[l] + i, sizeof(top));
+          top &= mask;
+
+          uint32_t blended;
+          switch (layer.mode) {
+            case BLEND_ADD:
+              blended = _addWord(result, top);
+              break;
+            case BLEND_MULTIPLY:
+              blended = _multiplyWord(result, top);
+              break;
+            case BLEND_MAX:
+              blended = _maxWord(result, top);
+              break;
+            case BLEND_OVER:
+            default:
+              blended = top ? top : result;
+              break;
+          }
+
+          if (layer.opacity < RATIO_ONE) {
+            blended = _lerpWord(result, blended, layer.opacity);
+          }
+
+          result = blended & mask;
+        }
+
+        int r = i % COMPOSITOR_RUN_PIXELS;
+        memcpy(run + r, &result, sizeof(result));
+
+        if (r == COMPOSITOR_RUN_PIXELS - 1 || i == pixelCount - 1) {
+          this->strip->setPixels(i - r, run, r + 1);
+        }
+      }
+    }
+
+    StripT* strip;
+
+    Layer layers[COMPOSITOR_MAX_LAYERS];
+    int layerCount;
+
+    bool changed;             // A layer changed since the last frame shown.
+    system_tick_t lastShow;   // micros() time the last frame was shown.
+    system_tick_t nextDraw;
+};
+
+typedef BasicCompositor<ColorStrip> Compositor;
+
+#endif
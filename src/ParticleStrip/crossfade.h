@@ -0,0 +1,259 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+#ifndef CROSSFADE_H
+#define CROSSFADE_H
+
+#include "frame-strip.h"
+#include "patterns.h"
+
+//
+// A pattern that switches within a bounded time, instead of at the end of an
+// animation cycle, fading from the old pattern to the new one.
+//
+// A BasicPattern only takes a new pattern at a clean break in the current
+// one, which for a slow LAVA or FLICKER can be seconds away. A
+// CrossfadePattern waits at most maxLatency ms for a clean break. After that,
+// the new pattern starts straight away, and the strip fades from the old one
+// to it over fade ms, while both keep animating.
+//
+//   DotStrip dotRgb(60);
+//   CrossfadePattern pattern(&dotRgb, 500);  // Fade for 500ms.
+//
+//   pattern.setPattern(PULSE, BLUE, BLACK, 400);  // On the next frame.
+//
+// Each pattern draws into a frame buffer of its own (a FrameStrip), which is
+// copied, or blended, onto the strip. A clean break switches without a fade,
+// as usual. Switching again during a fade drops the oldest pattern.
+//
+// It has the same interface as BasicPattern, so it can be used with a
+// BasicPatternScheduler or BasicPatternRenderer.
+//
+
+#define DEFAULT_CROSSFADE_MS (500)
+
+// Pixels mixed on the stack at a time, while fading.
+#define CROSSFADE_RUN_PIXELS (32)
+
+template<typename StripT>
+class BasicCrossfadePattern {
+  public:
+    inline BasicCrossfadePattern(StripT* strip,
+                                 unsigned long fade=DEFAULT_CROSSFADE_MS,
+                                 unsigned long maxLatency=0) :
+        strip(strip),
+        firstCanvas(strip->getPixelCount()),
+        secondCanvas(strip->getPixelCount()),
+        firstPattern(&firstCanvas),
+        secondPattern(&secondCanvas),
+        current(0),
+        fading(false),
+        fadeStart(0),
+        waiting(false),
+        waitingSince(0),
+        nextDraw(micros()) {
+      this->canvases[0] = &this->firstCanvas;
+      this->canvases[1] = &this->secondCanvas;
+      this->patterns[0] = &this->firstPattern;
+      this->patterns[1] = &this->secondPattern;
+
+      // Patterns draw no faster than the strip can show.
+      unsigned long interval = strip->getFrameInterval();
+      int frameRate = interval ? 1000000 / interval : 0;
+      this->firstCanvas.setMaxFrameRate(frameRate);
+      this->secondCanvas.setMaxFrameRate(frameRate);
+
+      this->setFade(fade);
+      this->setMaxLatency(maxLatency);
+    }
+
+    // Time to fade between patterns, in ms. 0 switches without fading.
+    inline void setFade(unsigned long fade) {
+      this->fadeTime = fade * 1000;
+    }
+
+    // Longest to wait for a clean break before switching, in ms.
+    inline void setMaxLatency(unsigned long maxLatency) {
+      this->maxLatency = maxLatency * 1000;
+    }
+
+    inline PatternDescription getPattern() {
+      return this->patterns[this->current]->getPattern();
+    }
+
+    inline void setPattern(PatternType pattern, Color a, Color b, int speed) {
+      this->setPattern(PatternDescription(pattern, a, b, speed));
+    }
+
+    inline void setPattern(const PatternDescription &next) {
+      this->patterns[this->current]->setPattern(next);
+
+      if (!this->waiting) {
+        this->waiting = true;
+        this->waitingSince = micros();
+      }
+
+      this->limitNextDraw();
+    }
+
+    // True while fading between patterns.
+    inline bool isFading() { return this->fading; }
+
+    // micros() time at which the next frame is due.
+    inline system_tick_t getNextDraw() {
+      return this->nextDraw;
+    }
+
+    // Returns true, if the Pattern was updated.
+    inline bool drawUpdate() {
+      system_tick_t now = micros();
+
+      if ((int32_t)(now - this->nextDraw) < 0)
+        return false;
+
+      bool updated = false;
+      PatternDescription next;
+
+      if (this->waiting &&
+          (now - this->waitingSince) >= this->maxLatency &&
+          this->patterns[this->current]->takeNextPattern(&next)) {
+        this->current ^= 1;
+        this->patterns[this->current]->startPattern(next);
+
+        this->fading = this->fadeTime != 0;
+        this->fadeStart = now;
+        this->waiting = false;
+        updated = true;
+      }
+
+      BasicPattern<FrameStrip>* incoming = this->patterns[this->current];
+      BasicPattern<FrameStrip>* outgoing = this->patterns[this->current ^ 1];
+
+      // A clean break.
+      if (incoming->drawUpdate()) {
+        this->waiting = false;
+        updated = true;
+      }
+
+      bool changed = this->canvases[this->current]->takeFrame();
+
+      if (this->fading) {
+        outgoing->drawUpdate();
+        this->canvases[this->current ^ 1]->takeFrame();
+
+        uint32_t elapsed = now - this->fadeStart;
+        if (elapsed < this->fadeTime) {
+          this->blend((uint64_t)elapsed * RATIO_ONE / this->fadeTime);
+        } else {
+          this->fading = false;
+          changed = true;
+        }
+      }
+
+      if (changed && !this->fading) {
+        this->copy();
+      }
+
+      // Fade on every frame the strip allows, otherwise only when the
+      // pattern is due.
+      this->nextDraw = incoming->getNextDraw();
+      if (this->fading) {
+        unsigned long interval = this->strip->getFrameInterval();
+        this->nextDraw = now + (interval ? interval : 1000);
+      }
+      this->limitNextDraw();
+
+      return updated;
+    }
+
+  private:
+    // Bring the next draw forward, to switch within maxLatency.
+    inline void limitNextDraw() {
+      if (!this->waiting)
+        return;
+
+      system_tick_t deadline = this->waitingSince + this->maxLatency;
+      if ((int32_t)(deadline - this->nextDraw) < 0) {
+        this->nextDraw = deadline;
+      }
+    }
+
+    // Show the current pattern's frame. Stored with setPixels(), so the
+    // strip still skips sending unchanged frames, and keeps its power
+    // estimate up to date.
+    inline void copy() {
+      const Color* frame = this->canvases[this->current]->readPixelBuffer();
+      int pixelCount = this->strip->getPixelCount();
+
+      if (pixelCount > this->canvases[this->current]->getPixelCount())
+        return;
+
+      this->strip->setPixels(0, frame, pixelCount);
+      this->strip->finishDraw();
+    }
+
+    // Show ratio of the way from the old pattern's frame to the new one,
+    // mixed a run of pixels at a time.
+    inline void blend(ColorRatio ratio) {
+      const Color* from = this->canvases[this->current ^ 1]->readPixelBuffer();
+      const Color* to = this->canvases[this->current]->readPixelBuffer();
+      int pixelCount = this->strip->getPixelCount();
+
+      if (pixelCount > this->canvases[0]->getPixelCount() ||
+          pixelCount > this->canvases[1]->getPixelCount())
+        return;
+
+      Color mixed[CROSSFADE_RUN_PIXELS];
+      for (int i = 0; i < pixelCount; i += CROSSFADE_RUN_PIXELS) {
+        int count = pixelCount - i < CROSSFADE_RUN_PIXELS ?
+            pixelCount - i : CROSSFADE_RUN_PIXELS;
+        mixBuffer(mixed, from + i, to + i, count, ratio);
+        this->strip->setPixels(i, mixed, count);
+      }
+
+      this->strip->finishDraw();
+    }
+
+    StripT* strip;
+
+    FrameStrip firstCanvas;
+    FrameStrip secondCanvas;
+    BasicPattern<FrameStrip> firstPattern;
+    BasicPattern<FrameStrip> secondPattern;
+
+    // Indexed by current, for the pattern being switched to, or shown.
+    FrameStrip* canvases[2];
+    BasicPattern<FrameStrip>* patterns[2];
+    int current;
+
+    uint32_t fadeTime;         // us.
+    uint32_t maxLatency;       // us.
+
+    bool fading;
+    system_tick_t fadeStart;   // micros() time the fade started.
+
+    bool waiting;              // A new pattern is waiting for a clean break.
+    system_tick_t waitingSince;
+
+    system_tick_t nextDraw;
+};
+
+typedef BasicCrossfadePattern<ColorStrip> CrossfadePattern;
+
+#endif
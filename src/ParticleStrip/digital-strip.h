@@ -21,6 +21,7 @@
 #define DIGITAL_STRIP_H
 
 #include "strip.h"
+#include "spi-output.h"
 
 // Implements the ColorStrip interface for a LPD8806 RGB LED strip.
 
@@ -34,41 +35,96 @@
 //   Strip CI (clock in) be connected to Core A3.
 //   Strip DI (data in) in connected to Core A5.
 //   GND to Ground.
+//
+// If async is true, frames are sent with DMA in the background, and
+// finishDraw returns without waiting for the transfer. bus selects SPI, SPI1
+// or software SPI, and the clock speed (see spi-output.h).
 class DigitalStrip : public ColorStrip   {
   public:
-    inline DigitalStrip(int pixelCount) :
-        ColorStrip(pixelCount) {
+    inline DigitalStrip(int pixelCount, bool async=false,
+                        PixelFormat pixelFormat=PIXEL_COLOR,
+                        const SpiBus& bus=SpiBus()) :
+        DigitalStrip(pixelCount, async, pixelFormat, bus, NULL, NULL) {}
+
+    // Bytes sent per frame: pixels, then the latch.
+    static constexpr int wireSize(int pixelCount) {
+      return pixelCount * 3 + latchSize(pixelCount);
+    }
+
+    // True while a frame is still being sent in the background.
+    inline bool isSending() { return this->spi.isSending(); }
+    inline void waitForSend() { this->spi.waitForSend(); }
+
+    virtual inline void finishDraw() final {
+      this->finishDrawWith([this] { this->DigitalStrip::show(); });
+    }
 
-      SPI.begin();
-      SPI.setBitOrder(MSBFIRST);
-      SPI.setDataMode(SPI_MODE0);
+  protected:
+    // Draw into storage provided by a subclass (see FixedDigitalStrip).
+    inline DigitalStrip(int pixelCount, bool async, PixelFormat pixelFormat,
+                        const SpiBus& bus, uint8_t* frameBuffer,
+                        uint8_t* wireStorage) :
+        ColorStrip(pixelCount,
+                   pixelFormat == PIXEL_WIRE ? PIXEL_RGB888 : pixelFormat,
+                   frameBuffer),
+        spi(wireSize(pixelCount), async, wireStorage, bus) {
+
+      // GRB color order, oddly, and only 7 bits are significant. The high
+      // bit is always set on color bytes.
+      this->output.setOrder(ORDER_GRB);
+      this->output.setWireFormat(7, 0x80);
+
+      this->spi.begin();
 
       this->finishDraw();
       drawSolid(BLACK);
     }
 
-    virtual inline void drawPixel(Color color) {
-      ColorStrip::drawPixel(color);
+    virtual inline void show() {
+      uint8_t* wire = this->spi.buffer();
+      if (!wire)
+        return;
+
+      for (int i = 0; i < this->pixelCount; i++) {
+        this->output.encode(wire, this->getPixel(i));
+        wire += 3;
+      }
 
-    // GRB color order, oddly, and only 0x7F is sinificant, so
-    // through away least significant bit.
-      SPI.transfer(color.green >> 1 | 0x80);
-      SPI.transfer(color.red >> 1   | 0x80);
-      SPI.transfer(color.blue >> 1  | 0x80);
+      // Send pixels, followed by enough zeros to latch all pixel controllers
+      // and prepare for new draws.
+      this->spi.send();
     }
 
-    virtual inline void finishDraw() {
-      ColorStrip::finishDraw();
+  private:
+    static constexpr int latchSize(int pixelCount) {
+      return ((pixelCount+31) / 32) * 8;
+    }
 
-    // Transfer enough zeros to latch all pixel controllers and prepare
-    // for new draws.
-      int latch_size = ((this->pixelCount+31) / 32) * 8;
+    SpiOutput spi;
+};
 
-      for (int i = 0; i < latch_size; i++) {
-        SPI.transfer(0);
-      }
-    }
+template<int N, bool ASYNC, PixelFormat FORMAT>
+struct FixedDigitalStorage {
+  uint8_t frameStorage[ColorStrip::frameBufferSize(FORMAT, N)];
+  uint8_t wireStorage[SpiOutput::storageSize(DigitalStrip::wireSize(N),
+                                             ASYNC)];
+};
+
+// A DigitalStrip of N pixels that never allocates (see FixedDotStrip in
+// dot-strip.h).
+//
+//   FixedDigitalStrip<32> digitalRgb;
+template<int N, bool ASYNC=false, PixelFormat FORMAT=PIXEL_COLOR>
+class FixedDigitalStrip : private FixedDigitalStorage<N, ASYNC, FORMAT>,
+                          public DigitalStrip {
+  static_assert(N > 0, "FixedDigitalStrip needs at least one pixel");
+  static_assert(FORMAT != PIXEL_WIRE,
+                "DigitalStrip stores PIXEL_WIRE as RGB888");
 
+  public:
+    inline FixedDigitalStrip(const SpiBus& bus=SpiBus()) :
+        DigitalStrip(N, ASYNC, FORMAT, bus,
+                     this->frameStorage, this->wireStorage) {}
 };
 
 #endif
@@ -21,6 +21,7 @@
 #define DOT_STRIP_H
 
 #include "strip.h"
+#include "spi-output.h"
 
 // Implements the ColorStrip interface for a LPD8806 RGB LED strip.
 
@@ -43,44 +44,153 @@
 // Strip +5V in to 5V (NOT from the Spark Core, it's too much power draw).
 // Strip GND to Ground.
 
+// If async is true, frames are sent with DMA in the background, and
+// finishDraw returns without waiting for the transfer. bus selects SPI, SPI1
+// or software SPI, and the clock speed (see spi-output.h).
+//
+// Each APA102 pixel has a 5 bit global current control, in addition to the
+// 8 bit PWM per color. Normally it's left at full current. In HDR mode, each
+// pixel is sent at the lowest current that can reach its brightest channel,
+// with the PWM values scaled up to match. Dim colors (low brightness, or
+// gamma corrected) then keep close to 8 bits of resolution, instead of
+// collapsing into a few PWM steps.
+
 class DotStrip : public ColorStrip   {
   public:
-    inline DotStrip(int pixelCount) :
-        ColorStrip(pixelCount) {
+    inline DotStrip(int pixelCount, bool async=false,
+                    PixelFormat pixelFormat=PIXEL_COLOR,
+                    const SpiBus& bus=SpiBus()) :
+        DotStrip(pixelCount, async, pixelFormat, bus, NULL, NULL) {}
+
+    // Bytes sent per frame: start frame, pixels, and end frame.
+    static constexpr int wireSize(int pixelCount) {
+      return START_FRAME_SIZE + pixelCount * 4 + endFrameSize(pixelCount);
+    }
+
+    inline void setHdr(bool hdr) {
+      this->hdr = hdr;
+      this->markDirty();
+    }
+
+    // True while a frame is still being sent in the background.
+    inline bool isSending() { return this->spi.isSending(); }
+    inline void waitForSend() { this->spi.waitForSend(); }
+
+    virtual inline void finishDraw() final {
+      this->finishDrawWith([this] { this->DotStrip::show(); });
+    }
+
+  protected:
+    // Draw into storage provided by a subclass (see FixedDotStrip), instead
+    // of allocating it.
+    inline DotStrip(int pixelCount, bool async, PixelFormat pixelFormat,
+                    const SpiBus& bus, uint8_t* frameBuffer,
+                    uint8_t* wireStorage) :
+        ColorStrip(pixelCount,
+                   pixelFormat == PIXEL_WIRE ? PIXEL_RGB888 : pixelFormat,
+                   frameBuffer),
+        spi(wireSize(pixelCount), async, wireStorage, bus),
+        hdr(false) {
+
+      this->output.setOrder(ORDER_GBR);
 
-      SPI.begin();
-      SPI.setBitOrder(MSBFIRST);
-      SPI.setDataMode(SPI_MODE0);
+      this->spi.begin();
 
       drawSolid(BLACK);
     }
 
-    virtual inline void drawPixel(Color color) {
-      if (this->drawOffset == 0) {
-        // Signal the start of draw.
-        SPI.transfer(0x00);
-        SPI.transfer(0x00);
-        SPI.transfer(0x00);
-        SPI.transfer(0x00);
+    virtual inline void show() {
+      if (!this->spi.buffer())
+        return;
+
+      uint8_t* wire = this->spi.buffer() + START_FRAME_SIZE;
+
+      if (this->hdr) {
+        for (int i = 0; i < this->pixelCount; i++) {
+          this->encodeHdr(wire, this->getPixel(i));
+          wire += 4;
+        }
+      } else {
+        for (int i = 0; i < this->pixelCount; i++) {
+          *wire++ = 0xFF;
+          this->output.encode(wire, this->getPixel(i));
+          wire += 3;
+        }
       }
 
-      ColorStrip::drawPixel(color);
+      // Start frame, pixels, and end frame in one transfer.
+      this->spi.send();
+    }
 
-      SPI.transfer(0xFF);
-      SPI.transfer(color.green);
-      SPI.transfer(color.blue);
-      SPI.transfer(color.red);
+  private:
+    static const int START_FRAME_SIZE = 4;
+
+    // Split the 16 bit output levels of a color into a global current (1-31)
+    // and PWM values. A channel at level L is sent as PWM value P at current
+    // G, for L ~= 65535 * (G / 31) * (P / 255).
+    inline void encodeHdr(uint8_t* wire, Color color) {
+      uint32_t red = this->output.level(color.red);
+      uint32_t green = this->output.level(color.green);
+      uint32_t blue = this->output.level(color.blue);
+
+      uint32_t brightest = red > green ? red : green;
+      brightest = brightest > blue ? brightest : blue;
+
+      // Lowest current that reaches the brightest channel.
+      uint32_t current = (brightest * 31 + 65534) / 65535;
+      if (current == 0)
+        current = 1;
+
+      // 65535 == 255 * 257, so each PWM step at this current is
+      // current * 257 / 31 levels.
+      uint32_t step = current * 257;
+      uint32_t half = step / 2;
+
+      *wire++ = 0xE0 | current;
+      this->output.write(wire,
+                         hdrShade((red * 31 + half) / step),
+                         hdrShade((green * 31 + half) / step),
+                         hdrShade((blue * 31 + half) / step));
     }
 
-    virtual inline void finishDraw() {
-      ColorStrip::finishDraw();
+    static inline uint8_t hdrShade(uint32_t shade) {
+      return shade > 255 ? 255 : shade;
+    }
 
-      // Signal the end of draw.
-      SPI.transfer(0x00);
-      SPI.transfer(0x00);
-      SPI.transfer(0x00);
-      SPI.transfer(0x00);
+    // The end frame must provide half a clock per pixel, to push data all
+    // the way down the strip, and never less than 4 bytes.
+    static constexpr int endFrameSize(int pixelCount) {
+      return (pixelCount + 15) / 16 < 4 ? 4 : (pixelCount + 15) / 16;
     }
+
+    SpiOutput spi;
+    bool hdr;
+};
+
+// Buffers for FixedDotStrip. A base class, so they exist before the DotStrip
+// that uses them is constructed.
+template<int N, bool ASYNC, PixelFormat FORMAT>
+struct FixedDotStorage {
+  uint8_t frameStorage[ColorStrip::frameBufferSize(FORMAT, N)];
+  uint8_t wireStorage[SpiOutput::storageSize(DotStrip::wireSize(N), ASYNC)];
+};
+
+// A DotStrip of N pixels, with its buffers inside the object instead of on
+// the heap. As a global, its RAM use is known at link time, and constructing
+// it never allocates.
+//
+//   FixedDotStrip<60> dotRgb;
+//   FixedDotStrip<144, true, PIXEL_RGB565> asyncDotRgb;
+template<int N, bool ASYNC=false, PixelFormat FORMAT=PIXEL_COLOR>
+class FixedDotStrip : private FixedDotStorage<N, ASYNC, FORMAT>,
+                      public DotStrip {
+  static_assert(N > 0, "FixedDotStrip needs at least one pixel");
+  static_assert(FORMAT != PIXEL_WIRE, "DotStrip stores PIXEL_WIRE as RGB888");
+
+  public:
+    inline FixedDotStrip(const SpiBus& bus=SpiBus()) :
+        DotStrip(N, ASYNC, FORMAT, bus,
+                 this->frameStorage, this->wireStorage) {}
 };
 
 #endif
@@ -0,0 +1,56 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+#ifndef FRAME_STRIP_H
+#define FRAME_STRIP_H
+
+#include "strip.h"
+
+// A ColorStrip that isn't connected to anything. Patterns can draw into it,
+// for the frame to be combined with others, and drawn on a real strip (see
+// crossfade.h).
+//
+// finishDraw() sends nothing. It marks a frame as finished, for takeFrame().
+
+class FrameStrip : public ColorStrip {
+  public:
+    inline FrameStrip(int pixelCount, PixelFormat pixelFormat=PIXEL_COLOR,
+                      uint8_t* frameBuffer=NULL) :
+        ColorStrip(pixelCount,
+                   pixelFormat == PIXEL_WIRE ? PIXEL_COLOR : pixelFormat,
+                   frameBuffer),
+        finished(false) {}
+
+    virtual inline void finishDraw() final {
+      this->drawOffset = 0;
+      this->finished = true;
+    }
+
+    // True if a frame was finished since the last call.
+    inline bool takeFrame() {
+      bool finished = this->finished;
+      this->finished = false;
+      return finished;
+    }
+
+  private:
+    bool finished;
+};
+
+#endif
@@ -0,0 +1,53 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+#ifndef GPIO_PORT_H
+#define GPIO_PORT_H
+
+#include <application.h>
+
+//
+// Set or clear several pins of one GPIO port, in a single register write.
+//
+// The STM32F2 (Photon, P1, Electron) has separate 16 bit set and reset
+// registers, BSRRL and BSRRH. The STM32F1 on the Core sets pins through the
+// low half of BSRR, and clears them through BRR.
+//
+
+#if defined(PLATFORM_ID) && PLATFORM_ID == 0
+#define GPIO_PORT_STM32F1 (1)
+#endif
+
+inline void setPortPins(GPIO_TypeDef* port, uint16_t pins) {
+#if GPIO_PORT_STM32F1
+  port->BSRR = pins;
+#else
+  port->BSRRL = pins;
+#endif
+}
+
+inline void clearPortPins(GPIO_TypeDef* port, uint16_t pins) {
+#if GPIO_PORT_STM32F1
+  port->BRR = pins;
+#else
+  port->BSRRH = pins;
+#endif
+}
+
+#endif
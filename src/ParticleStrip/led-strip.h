@@ -43,9 +43,11 @@ class LedStrip : public ColorStrip   {
   public:
     inline LedStrip(int red_pin, int green_pin, int blue_pin,
                     bool common_anode=true) :
-          ColorStrip(1, false),
-          red_pin(red_pin), green_pin(green_pin), blue_pin(blue_pin),
-          common_anode(common_anode) {
+          ColorStrip(1),
+          red_pin(red_pin), green_pin(green_pin), blue_pin(blue_pin) {
+
+      // Common anode LEDs are lit by pulling the pin low.
+      this->output.setWireFormat(8, 0x00, common_anode);
 
       pinMode(this->red_pin, OUTPUT);
       pinMode(this->green_pin, OUTPUT);
@@ -54,23 +56,22 @@ class LedStrip : public ColorStrip   {
       drawSolid(BLACK);
     }
 
-    virtual inline void drawPixel(Color color) {
-      if (this->drawOffset >= this->pixelCount) {
-        return;
-      }
-      this->drawOffset++;
+    virtual inline void finishDraw() final {
+      this->finishDrawWith([this] { this->LedStrip::show(); });
+    }
 
-      if (this->common_anode)
-        color = invertColor(color);
+  protected:
+    virtual inline void show() {
+      uint8_t rgb[3];
+      this->output.encode(rgb, this->getPixel(0));
 
-      analogWrite(this->red_pin, color.red);
-      analogWrite(this->green_pin, color.green);
-      analogWrite(this->blue_pin, color.blue);
+      analogWrite(this->red_pin, rgb[0]);
+      analogWrite(this->green_pin, rgb[1]);
+      analogWrite(this->blue_pin, rgb[2]);
     }
 
   private:
     int red_pin, green_pin, blue_pin;
-    bool common_anode;
 };
 
 #endif
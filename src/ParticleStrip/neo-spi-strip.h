@@ -0,0 +1,196 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+
+#ifndef NEO_SPI_STRIP_H
+#define NEO_SPI_STRIP_H
+
+#include "strip.h"
+#include "spi-output.h"
+#include "neo-strip.h"
+
+//
+// NeoPixel strips driven from a SPI MOSI pin (A5 for SPI, D2 for SPI1),
+// instead of a bit banged pin. NeoStrip's library disables interrupts for
+// about 30us per pixel while it sends; this sends from a wire buffer with
+// interrupts left on, and in the background with DMA if async is true (see
+// spi-output.h).
+//
+// Each NeoPixel bit is sent as a symbol of 3 to 6 SPI bits, about 1/3 high
+// for a 0 and 2/3 high for a 1 (eg 100 and 110, or 10000 and 11100). The bus
+// can only divide its clock by powers of two, so the strip asks for at most
+// 6 times the pixel bit rate (800kHz, or 400kHz for TM1803), and sizes the
+// symbol to the clock it gets. On a Photon that is 3.75MHz (1.875MHz for
+// TM1803) and 5 bit symbols, a pixel bit rate of 750kHz, which is within the
+// WS2811, WS2812 and WS2812B timings. Each color byte is expanded through a
+// compile time table of 4 bit patterns. Each frame is followed by
+// NEO_SPI_RESET_US of zeros, so the pixels latch it.
+//
+// The strip needs its SPI bus to itself, since anything else sent on MOSI
+// would be seen as pixel data. TM1829 pixels idle high, and can't be driven
+// this way, so a TM1829 strip has no pixels and sends nothing.
+//
+// The wire buffer is 3 bytes per pixel for each bit of the symbol, so 15
+// bytes on a Photon, plus the reset (twice that if async).
+//
+
+// SPI bits sent for each NeoPixel bit.
+#define NEO_SPI_MIN_SYMBOL_BITS (3)
+#define NEO_SPI_MAX_SYMBOL_BITS (6)
+
+// Low time after each frame. WS2812B needs at least 280us.
+#define NEO_SPI_RESET_US (300)
+
+// High bits at the start of a symbol "width" bits wide.
+constexpr int _neoSpiHighBits(bool one, int width) {
+  return one ? (2 * width + 1) / 3 : width / 3;
+}
+
+constexpr uint32_t _neoSpiSymbol(bool one, int width) {
+  return ((1u << _neoSpiHighBits(one, width)) - 1) <<
+      (width - _neoSpiHighBits(one, width));
+}
+
+// SPI bits for the low "bits" bits of value, MSB first.
+constexpr uint32_t _neoSpiBits(int value, int bits, int width) {
+  return bits == 0 ? 0 :
+      (_neoSpiBits(value >> 1, bits - 1, width) << width) |
+      _neoSpiSymbol(value & 1, width);
+}
+
+// Symbol width for a clock and bit rate, within the widths in the table.
+constexpr int _neoSpiWidth(unsigned clock, unsigned bitRate) {
+  return (clock + bitRate / 2) / bitRate < NEO_SPI_MIN_SYMBOL_BITS ?
+      NEO_SPI_MIN_SYMBOL_BITS :
+      (clock + bitRate / 2) / bitRate > NEO_SPI_MAX_SYMBOL_BITS ?
+      NEO_SPI_MAX_SYMBOL_BITS : (clock + bitRate / 2) / bitRate;
+}
+
+template<typename List> struct _NeoSpiTable;
+
+// The bits for each 4 bit value, 16 for each symbol width from
+// NEO_SPI_MIN_SYMBOL_BITS.
+template<int... I>
+struct _NeoSpiTable<_IndexList<I...> > {
+  static constexpr uint32_t values[sizeof...(I)] = {
+    _neoSpiBits(I % 16, 4, NEO_SPI_MIN_SYMBOL_BITS + I / 16)...
+  };
+};
+
+template<int... I>
+constexpr uint32_t _NeoSpiTable<_IndexList<I...> >::values[sizeof...(I)];
+
+typedef _NeoSpiTable<_MakeIndexList<
+    16 * (NEO_SPI_MAX_SYMBOL_BITS - NEO_SPI_MIN_SYMBOL_BITS + 1)>::type>
+    NeoSpiTable;
+
+static_assert(_neoSpiBits(0x0, 4, 3) == 0x924, "3 bit 0s must be 100.");
+static_assert(_neoSpiBits(0xF, 4, 3) == 0xDB6, "3 bit 1s must be 110.");
+static_assert(_neoSpiBits(0x8, 4, 3) == 0xD24, "Bits must be MSB first.");
+static_assert(_neoSpiBits(0x1, 2, 5) == 0x21C, "5 bit symbols must be "
+              "10000 and 11100.");
+
+class NeoSpiStrip : public ColorStrip   {
+  public:
+    inline NeoSpiStrip(int pixelCount, uint8_t neoType=WS2812B,
+                       bool async=false,
+                       PixelFormat pixelFormat=PIXEL_COLOR,
+                       SPIClass& spi=SPI) :
+        ColorStrip(neoType == TM1829 ? 0 : pixelCount,
+                   pixelFormat == PIXEL_WIRE ? PIXEL_RGB888 : pixelFormat),
+        spi(wireSize(neoType == TM1829 ? 0 : pixelCount, neoType,
+                     SpiBus(spi).index()), async, NULL,
+            SpiBus(spi, clockSpeed(neoType, SpiBus(spi).index()))),
+        symbolWidth(symbolBits(neoType, SpiBus(spi).index())) {
+      this->output.setOrder(neoColorOrder(neoType));
+
+      // TM1829 pixels would read MOSI idling low as data (see above).
+      if (neoType == TM1829)
+        return;
+
+      this->spi.begin();
+
+      drawSolid(BLACK);
+    }
+
+    // Nominal pixel bit rate for a pixel type, in Hz.
+    static constexpr unsigned bitRate(uint8_t neoType) {
+      return neoType == TM1803 ? 400000 : 800000;
+    }
+
+    // SPI clock a pixel type is sent at on a hardware bus, in Hz.
+    static constexpr unsigned clockSpeed(uint8_t neoType, int bus=0) {
+      return spiBusClock(bus, bitRate(neoType) * NEO_SPI_MAX_SYMBOL_BITS);
+    }
+
+    // SPI bits per NeoPixel bit: the clock over the bit rate, rounded.
+    static constexpr int symbolBits(uint8_t neoType, int bus=0) {
+      return _neoSpiWidth(clockSpeed(neoType, bus), bitRate(neoType));
+    }
+
+    // Bytes sent per frame: a byte per color byte for each symbol bit, then
+    // the reset.
+    static constexpr int wireSize(int pixelCount, uint8_t neoType=WS2812B,
+                                  int bus=0) {
+      return (pixelCount * 3 * symbolBits(neoType, bus) +
+              ((uint64_t)clockSpeed(neoType, bus) * NEO_SPI_RESET_US +
+               7999999) / 8000000);
+    }
+
+    // True while a frame is still being sent in the background.
+    inline bool isSending() { return this->spi.isSending(); }
+    inline void waitForSend() { this->spi.waitForSend(); }
+
+    virtual inline void finishDraw() final {
+      this->finishDrawWith([this] { this->NeoSpiStrip::show(); });
+    }
+
+  protected:
+    virtual inline void show() {
+      uint8_t* wire = this->spi.buffer();
+      if (!wire || !this->pixelCount)
+        return;
+
+      const uint32_t* table = &NeoSpiTable::values[
+          16 * (this->symbolWidth - NEO_SPI_MIN_SYMBOL_BITS)];
+      int width = this->symbolWidth;
+
+      for (int i = 0; i < this->pixelCount; i++) {
+        uint8_t rgb[3];
+        this->output.encode(rgb, this->getPixel(i));
+
+        // Each color byte is "width" wire bytes.
+        for (int c = 0; c < 3; c++) {
+          uint64_t bits = ((uint64_t)table[rgb[c] >> 4] << (width * 4)) |
+                          table[rgb[c] & 0xF];
+          for (int b = width - 1; b >= 0; b--)
+            *wire++ = bits >> (b * 8);
+        }
+      }
+
+      // The reset bytes after the pixels are never written, so stay zero.
+      this->spi.send();
+    }
+
+  private:
+    SpiOutput spi;
+    int symbolWidth;
+};
+
+#endif
@@ -49,6 +49,20 @@
 #include "strip.h"
 #include "neopixel.h"
 
+// Color order the NeoPixel library uses for each pixel type.
+inline ColorOrder neoColorOrder(uint8_t neoType) {
+  switch (neoType) {
+    case WS2812B:
+    case WS2812B2:
+    case WS2812:
+      return ORDER_GRB;
+    case TM1829:
+      return ORDER_RBG;
+    default:
+      return ORDER_RGB;
+  }
+}
+
 //
 // Adafruit NeoPixel strips.
 // Uses a single GPIO pin of your choice.
@@ -56,26 +70,51 @@
 // See AdaFruit guide for connecting hardware:
 //   https://learn.adafruit.com/adafruit-neopixel-uberguide/overview
 //
+// The NeoPixel library keeps its own array of wire bytes. Frames are encoded
+// straight into it. With the default PIXEL_COLOR, the strip also has a 4 byte
+// per pixel frame buffer, so 7 bytes per pixel in all, where older versions
+// used 3. Sketches short of RAM should use PIXEL_WIRE: that array is then the
+// frame buffer, and the strip needs no memory of its own (see strip.h for the
+// trade offs).
+//
+// The library bit bangs the pin with interrupts disabled, for about 30us per
+// pixel. NeoSpiStrip (see neo-spi-strip.h) sends from SPI instead.
+//
 class NeoStrip : public ColorStrip   {
   public:
-    inline NeoStrip(int pixelCount, int pin, uint8_t neoType=WS2812B) :
-        ColorStrip(pixelCount, false),
+    inline NeoStrip(int pixelCount, int pin, uint8_t neoType=WS2812B,
+                    PixelFormat pixelFormat=PIXEL_COLOR) :
+        ColorStrip(pixelCount, pixelFormat),
         neoLibrary(pixelCount, pin, neoType) {
+      this->output.setOrder(neoColorOrder(neoType));
       this->neoLibrary.begin();
+
+      if (pixelFormat == PIXEL_WIRE) {
+        this->useWireBuffer(this->neoLibrary.getPixels());
+      }
+
       drawSolid(BLACK);
     }
 
-    virtual inline void drawPixel(Color color) {
-      if (this->drawOffset >= this->pixelCount) {
+    virtual inline void finishDraw() final {
+      this->finishDrawWith([this] { this->NeoStrip::show(); });
+    }
+
+  protected:
+    virtual inline void show() {
+      // Already drawn in place.
+      if (this->pixelFormat == PIXEL_WIRE) {
+        this->neoLibrary.show();
         return;
       }
 
-      this->neoLibrary.setColor(this->drawOffset, color.red, color.green, color.blue);
-      this->drawOffset++;
-    }
+      // Encode straight into the NeoPixel library's pixel array.
+      uint8_t* wire = this->neoLibrary.getPixels();
 
-    virtual inline void finishDraw() {
-      ColorStrip::finishDraw();
+      for (int i = 0; i < this->pixelCount; i++) {
+        this->output.encode(wire, this->getPixel(i));
+        wire += 3;
+      }
 
       this->neoLibrary.show();
     }
@@ -0,0 +1,233 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "color.h"
+
+//
+// Output stage shared by all strips. Converts frame buffer colors into the
+// bytes a strip sends, applying gamma correction, global brightness, the
+// strip's channel order, and its wire format, in a single table lookup per
+// channel.
+//
+// The gamma curve is computed at compile time. The per strip table combining
+// it with brightness and wire format (256 bytes) is only rebuilt when a
+// setting changes.
+//
+
+// Gamma used when gamma correction is enabled. May be overridden at compile
+// time.
+#ifndef OUTPUT_GAMMA
+#define OUTPUT_GAMMA (2.8)
+#endif
+
+// Order in which channels are sent on the wire.
+typedef enum {
+  ORDER_RGB,
+  ORDER_RBG,
+  ORDER_GRB,
+  ORDER_GBR,
+  ORDER_BRG,
+  ORDER_BGR,
+} ColorOrder;
+
+//
+// Compile time gamma table. C++11 constexpr only allows recursion, so log and
+// exp are range reduced series.
+//
+
+constexpr double _LN2 = 0.69314718055994530942;
+
+// 2 * atanh(y), which is ln(x) for y = (x - 1) / (x + 1).
+constexpr double _atanhSeries(double y, double y2, double term, int n) {
+  return n > 41 ? 0 : term / n + _atanhSeries(y, y2, term * y2, n + 2);
+}
+
+// ln(x) for 0 < x <= 1, range reduced to [0.5, 1].
+constexpr double _ln(double x) {
+  return x < 0.5 ?
+      _ln(x * 2) - _LN2 :
+      2 * _atanhSeries((x - 1) / (x + 1),
+                       ((x - 1) / (x + 1)) * ((x - 1) / (x + 1)),
+                       (x - 1) / (x + 1), 1);
+}
+
+constexpr double _expSeries(double x, double term, int n) {
+  return n > 16 ? term : term + _expSeries(x, term * x / n, n + 1);
+}
+
+constexpr double _square(double x) { return x * x; }
+
+// exp(x), range reduced to |x| <= 0.5.
+constexpr double _exp(double x) {
+  return (x < -0.5 || x > 0.5) ? _square(_exp(x / 2)) : _expSeries(x, 1, 1);
+}
+
+// 16 bit linear output level for an 8 bit shade.
+constexpr uint16_t _gamma16(int shade) {
+  return shade == 0 ? 0 :
+      (uint16_t)(_exp(OUTPUT_GAMMA * _ln(shade / 255.0)) * 65535 + 0.5);
+}
+
+template<int... I> struct _IndexList {};
+
+template<int N, int... I>
+struct _MakeIndexList : _MakeIndexList<N - 1, N - 1, I...> {};
+
+template<int... I>
+struct _MakeIndexList<0, I...> { typedef _IndexList<I...> type; };
+
+template<typename List> struct _GammaTable;
+
+template<int... I>
+struct _GammaTable<_IndexList<I...> > {
+  static constexpr uint16_t values[sizeof...(I)] = { _gamma16(I)... };
+};
+
+template<int... I>
+constexpr uint16_t _GammaTable<_IndexList<I...> >::values[sizeof...(I)];
+
+typedef _GammaTable<_MakeIndexList<256>::type> GammaTable;
+
+static_assert(_gamma16(255) == 65535, "Gamma table must end at full scale.");
+
+class ColorOutput {
+  public:
+    inline ColorOutput() :
+        brightness(255),
+        gamma(false),
+        inverted(false),
+        wireBits(8),
+        wireFlags(0) {
+      this->setOrder(ORDER_RGB);
+      this->rebuild();
+    }
+
+    inline void setOrder(ColorOrder order) {
+      // Wire offsets of red, green and blue, for each order.
+      static const uint8_t OFFSETS[][3] = {
+        {0, 1, 2},  // RGB
+        {0, 2, 1},  // RBG
+        {1, 0, 2},  // GRB
+        {2, 0, 1},  // GBR
+        {1, 2, 0},  // BRG
+        {2, 1, 0},  // BGR
+      };
+
+      this->order = order;
+      this->redOffset = OFFSETS[order][0];
+      this->greenOffset = OFFSETS[order][1];
+      this->blueOffset = OFFSETS[order][2];
+    }
+
+    inline ColorOrder getOrder() const { return this->order; }
+
+    inline void setBrightness(uint8_t brightness) {
+      this->brightness = brightness;
+      this->rebuild();
+    }
+
+    inline uint8_t getBrightness() const { return this->brightness; }
+
+    inline void setGamma(bool gamma) {
+      this->gamma = gamma;
+      this->rebuild();
+    }
+
+    inline bool getGamma() const { return this->gamma; }
+
+    // Shades are sent as (bits) wide values, or'd with flags. Inverted
+    // output sends full scale for off (eg: common anode LEDs).
+    inline void setWireFormat(uint8_t bits, uint8_t flags, bool inverted=false) {
+      this->wireBits = bits;
+      this->wireFlags = flags;
+      this->inverted = inverted;
+      this->rebuild();
+    }
+
+    // Linear output level of a shade, from 0 to 65535, after gamma but
+    // before brightness.
+    inline uint16_t linear(uint8_t shade) const {
+      return this->gamma ? GammaTable::values[shade] : shade * 257;
+    }
+
+    // Linear output level of a shade, from 0 to 65535, after gamma and
+    // brightness.
+    inline uint16_t level(uint8_t shade) const {
+      return (this->linear(shade) * this->scale()) >> 8;
+    }
+
+    // Brightness as a 0 - 256 multiplier.
+    inline uint32_t scale() const {
+      return this->brightness + (this->brightness >> 7);
+    }
+
+    // Write a color as three wire bytes, in wire order.
+    inline void encode(uint8_t* wire, Color color) const {
+      this->write(wire,
+                  this->table[color.red],
+                  this->table[color.green],
+                  this->table[color.blue]);
+    }
+
+    // Write already converted wire bytes, in wire order.
+    inline void write(uint8_t* wire,
+                      uint8_t red, uint8_t green, uint8_t blue) const {
+      wire[this->redOffset] = red;
+      wire[this->greenOffset] = green;
+      wire[this->blueOffset] = blue;
+    }
+
+    // Read back three bytes written with write(), as a Color.
+    inline Color read(const uint8_t* wire) const {
+      return Color{0x00,
+                   wire[this->redOffset],
+                   wire[this->greenOffset],
+                   wire[this->blueOffset]};
+    }
+
+  private:
+    inline void rebuild() {
+      uint32_t maxShade = (1 << this->wireBits) - 1;
+
+      for (int shade = 0; shade < 256; shade++) {
+        uint32_t value = (this->level(shade) * maxShade + 32767) / 65535;
+
+        if (this->inverted)
+          value = maxShade - value;
+
+        this->table[shade] = value | this->wireFlags;
+      }
+    }
+
+    ColorOrder order;
+    uint8_t redOffset, greenOffset, blueOffset;
+
+    uint8_t brightness;
+    bool gamma;
+    bool inverted;
+    uint8_t wireBits;
+    uint8_t wireFlags;
+
+    uint8_t table[256];
+};
+
+#endif
@@ -0,0 +1,146 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include "color.h"
+
+//
+// A table of up to 256 colors, for strips that store palette indexes instead
+// of colors (see PixelFormat in strip.h). One palette can be shared by many
+// strips.
+//
+// Entry 0 is always BLACK, so a zeroed frame buffer is dark. Colors are added
+// as they are first drawn, until the palette is full. After that, colors are
+// drawn as the nearest entry, and nothing is ever evicted. That suits
+// patterns with a few distinct colors (SOLID, ALTERNATE, CYLON, TEST).
+//
+// Blended patterns (PULSE, LAVA) need a managed palette: otherwise the first
+// colors they draw fill it, and everything after is drawn as the nearest of
+// those. Either set() the colors wanted and setFixed(true), so drawing never
+// adds colors, or clear() the palette when switching patterns, before a frame
+// that redraws every pixel.
+//
+
+#define PALETTE_SIZE (256)
+
+class ColorPalette {
+  public:
+    inline ColorPalette() :
+        count(1), lastIndex(0), generation(0), fixed(false) {
+      this->colors[0] = BLACK;
+    }
+
+    // The palette used by palette strips that aren't given one. Allocated
+    // by the first such strip, so other programs don't carry it.
+    static inline ColorPalette* shared() {
+      static ColorPalette* palette = new ColorPalette();
+      return palette;
+    }
+
+    inline Color get(uint8_t index) { return this->colors[index]; }
+
+    // Replace an entry, or add one at the end. Strips already showing the
+    // entry change on their next frame.
+    inline void set(uint8_t index, Color color) {
+      color.special = 0;
+      if (index < this->count && this->colors[index] != color)
+        this->generation++;
+
+      this->colors[index] = color;
+      if (index >= this->count)
+        this->count = index + 1;
+    }
+
+    inline int getCount() { return this->count; }
+
+    // Remove every entry but BLACK. Pixels showing removed entries show
+    // whatever is added next in their place, until redrawn.
+    inline void clear() {
+      if (this->count > 1)
+        this->generation++;
+
+      this->count = 1;
+      this->lastIndex = 0;
+    }
+
+    // If fixed, drawing only picks the nearest entry, and never adds colors.
+    inline void setFixed(bool fixed) { this->fixed = fixed; }
+    inline bool getFixed() { return this->fixed; }
+
+    // Changes whenever an entry in use changes, so strips know to resend
+    // (and recount) their frames.
+    inline uint32_t getGeneration() { return this->generation; }
+
+    // Index of a color among the first limit entries. Adds the color if it's
+    // new and there is room (unless fixed), otherwise returns the nearest
+    // entry.
+    inline uint8_t index(Color color, int limit=PALETTE_SIZE) {
+      color.special = 0;
+
+      // Patterns usually draw runs of the same color.
+      if (this->lastIndex < limit && this->colors[this->lastIndex] == color)
+        return this->lastIndex;
+
+      int searched = this->count < limit ? this->count : limit;
+      for (int i = 0; i < searched; i++) {
+        if (this->colors[i] == color) {
+          this->lastIndex = i;
+          return i;
+        }
+      }
+
+      if (!this->fixed && this->count < limit) {
+        this->colors[this->count] = color;
+        this->lastIndex = this->count;
+        return this->count++;
+      }
+
+      return this->nearest(color, searched);
+    }
+
+  private:
+    inline uint8_t nearest(Color color, int searched) {
+      uint8_t best = 0;
+      uint32_t bestDistance = 0xFFFFFFFF;
+
+      for (int i = 0; i < searched; i++) {
+        int red = this->colors[i].red - color.red;
+        int green = this->colors[i].green - color.green;
+        int blue = this->colors[i].blue - color.blue;
+
+        uint32_t distance = red * red + green * green + blue * blue;
+        if (distance < bestDistance) {
+          best = i;
+          bestDistance = distance;
+        }
+      }
+
+      return best;
+    }
+
+    Color colors[PALETTE_SIZE];
+    int count;
+    int lastIndex;
+    uint32_t generation;
+    bool fixed;
+};
+
+#endif
@@ -0,0 +1,254 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+
+#ifndef PARALLEL_NEO_STRIPS_H
+#define PARALLEL_NEO_STRIPS_H
+
+#include "strip.h"
+#include "neo-strip.h"
+#include "gpio-port.h"
+
+//
+// Up to 8 NeoPixel strips, sent in a single timed pass on one GPIO port.
+//
+// Each strip is a NeoLane, drawn like any other strip. A lane's finishDraw()
+// only encodes its frame. ParallelNeoStrips::show() then sends every lane at
+// once, so a frame takes as long as the longest lane, instead of the sum of
+// them all.
+//
+//   NeoLane ring(24);
+//   NeoLane bar(60);
+//   ParallelNeoStrips neoPort;
+//
+//   void setup() {
+//     neoPort.add(&ring, D0);
+//     neoPort.add(&bar, D1);
+//   }
+//
+//   void loop() {
+//     ... draw on ring and bar, and call their finishDraw() ...
+//     neoPort.show();
+//   }
+//
+// For each byte position, the lanes' bytes are transposed as an 8x8 bit
+// matrix, giving one byte per bit time with a bit for each lane. Every bit
+// time then takes 3 writes to the port's set and reset registers: all lanes
+// high, the lanes sending a 0 low at 1/3 of the bit, and the rest low at 2/3.
+// Shorter lanes stay low once their data is sent.
+//
+// All pins must be on the same GPIO port (eg D0-D4 are PB7-PB3 on a Photon).
+// Interrupts are disabled for the whole pass, about 30us per pixel of the
+// longest lane (60us for TM1803). Timing uses the cycle counter
+// (System.ticks()), and the port set and reset registers (see gpio-port.h).
+//
+
+#define PARALLEL_NEO_LANES (8)
+
+// Low time between passes, so the pixels latch each frame.
+#define PARALLEL_NEO_RESET_US (300)
+
+class NeoLane : public ColorStrip   {
+  public:
+    inline NeoLane(int pixelCount, uint8_t neoType=WS2812B,
+                   PixelFormat pixelFormat=PIXEL_COLOR) :
+        ColorStrip(pixelCount, pixelFormat),
+        wire((uint8_t*)calloc(pixelCount * 3, 1)) {
+      this->output.setOrder(neoColorOrder(neoType));
+
+      if (pixelFormat == PIXEL_WIRE) {
+        this->useWireBuffer(this->wire);
+      } else if (!this->wire) {
+        this->pixelCount = 0;
+      }
+
+      drawSolid(BLACK);
+    }
+
+    virtual inline ~NeoLane() {
+      free(this->wire);
+    }
+
+    // The encoded frame, 3 bytes per pixel in wire order.
+    inline const uint8_t* getWire() { return this->wire; }
+    inline int getWireSize() { return this->pixelCount * 3; }
+
+    virtual inline void finishDraw() final {
+      this->finishDrawWith([this] { this->NeoLane::show(); });
+    }
+
+  protected:
+    virtual inline void show() {
+      // Already drawn in place.
+      if (this->pixelFormat == PIXEL_WIRE)
+        return;
+
+      uint8_t* wire = this->wire;
+      for (int i = 0; i < this->pixelCount; i++) {
+        this->output.encode(wire, this->getPixel(i));
+        wire += 3;
+      }
+    }
+
+  private:
+    NeoLane(const NeoLane&);
+    NeoLane& operator=(const NeoLane&);
+
+    uint8_t* wire;
+};
+
+class ParallelNeoStrips {
+  public:
+    // All lanes must be the same pixel type.
+    inline ParallelNeoStrips(uint8_t neoType=WS2812B) :
+        laneCount(0),
+        port(NULL),
+        lastShow(0) {
+      // 800kHz, or 400kHz for TM1803.
+      this->bitNanos = neoType == TM1803 ? 2500 : 1250;
+
+      memset(this->lowMasks, 0, sizeof(this->lowMasks));
+      memset(this->highMasks, 0, sizeof(this->highMasks));
+    }
+
+    // Send lane on pin. Returns false if all lanes are in use, or the pin is
+    // on a different port to the others.
+    inline bool add(NeoLane* lane, int pin) {
+      const STM32_Pin_Info& info = HAL_Pin_Map()[pin];
+
+      if (this->laneCount >= PARALLEL_NEO_LANES ||
+          !info.gpio_peripheral ||
+          (this->port && info.gpio_peripheral != this->port)) {
+        return false;
+      }
+
+      pinMode(pin, OUTPUT);
+      digitalWrite(pin, LOW);
+
+      int index = this->laneCount++;
+      this->port = info.gpio_peripheral;
+      this->lanes[index] = lane;
+      this->pinMasks[index] = info.gpio_pin;
+
+      // Pins for each value of a nibble of lanes.
+      uint16_t (&masks)[16] = index < 4 ? this->lowMasks : this->highMasks;
+      for (int n = 0; n < 16; n++) {
+        if (n & (1 << (index % 4)))
+          masks[n] |= info.gpio_pin;
+      }
+
+      return true;
+    }
+
+    inline int getLaneCount() { return this->laneCount; }
+
+    // Send the last frame encoded by each lane.
+    inline void show() {
+      if (!this->laneCount)
+        return;
+
+      int size = 0;
+      for (int l = 0; l < this->laneCount; l++) {
+        if (this->lanes[l]->getWireSize() > size)
+          size = this->lanes[l]->getWireSize();
+      }
+
+      // Let the last pass latch.
+      system_tick_t since = micros() - this->lastShow;
+      if (since < PARALLEL_NEO_RESET_US)
+        delayMicroseconds(PARALLEL_NEO_RESET_US - since);
+
+      uint32_t ticksPerMicro = System.ticksPerMicrosecond();
+      uint32_t bitTicks = this->bitNanos * ticksPerMicro / 1000;
+
+      noInterrupts();
+
+      uint32_t next = System.ticks();
+
+      for (int i = 0; i < size; i++) {
+        // Byte i of each lane, and the pins of lanes that are that long.
+        uint64_t column = 0;
+        uint16_t active = 0;
+
+        for (int l = 0; l < this->laneCount; l++) {
+          if (i < this->lanes[l]->getWireSize()) {
+            column |= (uint64_t)this->lanes[l]->getWire()[i] << (l * 8);
+            active |= this->pinMasks[l];
+          }
+        }
+
+        uint64_t slices = transpose8(column);
+
+        // Most significant bit first.
+        for (int b = 7; b >= 0; b--) {
+          uint8_t ones = slices >> (b * 8);
+          uint16_t onePins = this->lowMasks[ones & 0x0F] |
+                             this->highMasks[ones >> 4];
+
+          uint32_t start = waitUntil(next);
+          setPortPins(this->port, active);
+          waitUntil(start + bitTicks / 3);
+          clearPortPins(this->port, active & ~onePins);
+          waitUntil(start + bitTicks * 2 / 3);
+          clearPortPins(this->port, active);
+          next = start + bitTicks;
+        }
+      }
+
+      waitUntil(next);
+      interrupts();
+
+      this->lastShow = micros();
+    }
+
+    // Transpose an 8x8 bit matrix, with row r in byte r. Afterwards, bit r of
+    // byte c is what was bit c of byte r.
+    static inline uint64_t transpose8(uint64_t x) {
+      uint64_t t;
+      t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+      x = x ^ t ^ (t << 7);
+      t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+      x = x ^ t ^ (t << 14);
+      t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+      x = x ^ t ^ (t << 28);
+      return x;
+    }
+
+  private:
+    // Spin on the cycle counter until deadline. Returns the time reached.
+    static inline uint32_t waitUntil(uint32_t deadline) {
+      uint32_t now;
+      while ((int32_t)((now = System.ticks()) - deadline) < 0) {}
+      return now;
+    }
+
+    NeoLane* lanes[PARALLEL_NEO_LANES];
+    uint16_t pinMasks[PARALLEL_NEO_LANES];
+    int laneCount;
+
+    // Port pins of the lanes set in each nibble of a bit slice.
+    uint16_t lowMasks[16];
+    uint16_t highMasks[16];
+
+    GPIO_TypeDef* port;
+    uint32_t bitNanos;
+    system_tick_t lastShow;
+};
+
+#endif
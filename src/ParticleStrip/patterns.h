@@ -24,8 +24,19 @@
 
 #include "strip.h"
 
+// Default number of LAVA blobs (see setBlobCount).
 #define BLOB_COUNT (3)
 
+// Step size for the random walk patterns (FLICKER, LAVA), in us.
+#define PATTERN_TICK (10000)
+
+// Most ticks to catch up on after a stall.
+#define PATTERN_MAX_TICKS (100)
+
+// Longest time between frames, in us. Keeps deadlines comparable across
+// micros() wrapping.
+#define PATTERN_MAX_DELAY (0x40000000UL)
+
 typedef enum {
   SOLID,
   PULSE,
@@ -41,16 +52,21 @@ typedef enum {
 // colors RANDOM and RANDOM_PRIMARY to allow randomization.
 //
 // Speed affects the display speed of different patterns (measured in MS).
-// Roughly describes on 'cycle' of animation.
+// Roughly describes on 'cycle' of animation. Animations are driven by elapsed
+// time, so they keep the same speed whatever the frame rate, and drop frames
+// if the strip can't keep up. A cycle shorter than two frame intervals (20ms
+// at the default DEFAULT_MAX_FRAME_RATE) can't be shown, and the frames that
+// are drawn alias into a slow drift instead.
 //
 // SOLID: draws color A. Solid BLACK turns all lights off, minimum power draw.
-// PULSE: morphs between color A, and color B.
+// PULSE: morphs from color A to color B, and back again, each cycle.
 // CYLON: Draws a moving Cylon style 'eye' in color A over a background of B.
 // ALTERNATE: Each pixel is color a, then b, repeat. Alternate ever 'speed' ms.
 // FLICKER: Simulate a halloween flickering light. color A is 'on', color B is
 //          'off', speed ranges between 200-1000 are recommended.
-// LAVA: A lava lampish effect. Draw 3 blobs of color A over background of B,
-//       and morph them over time. Speed controls how long blobs last.
+// LAVA: A lava lampish effect. Draw blobs (3 by default) of color A over
+//       background of B, and morph them over time. Speed controls how long
+//       blobs last.
 // TEST: A test pattern to ensure a strip is working properly. Flashes
 //       Black, White, Red, Green, Blue, then repeates per-pixel.
 
@@ -91,7 +107,9 @@ inline bool operator !=(const PatternDescription &left, const PatternDescription
 //
 // It's generally safe to call "setPattern" to change the pattern at any time,
 // but the change won't take effect until after a clean break in the current
-// animation cycle.
+// animation cycle. It must be called from the same thread as drawUpdate(). To
+// draw on another thread, see PatternRenderer in render-thread.h. To switch
+// sooner, see CrossfadePattern in crossfade.h.
 //
 // If an event_name is given to the constructor, then getText() will be
 // published to it every time the pattern being displayed it updated.
@@ -101,12 +119,27 @@ inline bool operator !=(const PatternDescription &left, const PatternDescription
 // Night time: SOLID,0x5f5f5f00,0x00000000,1000
 // Midnight:   CYLON,0x00ff0000,0x00000000,1000
 // Lava Lamp:  LAVA,0X01000000,0X00000000,200
-// Doorbell:  PULSE,0X0000FF00,0X00000000,10
+// Doorbell:   PULSE,0X0000FF00,0X00000000,400
+//
+// BasicPattern draws on a StripT. Given a concrete strip type (DotStrip,
+// DigitalStrip, NeoStrip or LedStrip), the compiler can inline every pixel
+// write and finishDraw(), instead of calling through ColorStrip's vtable:
+//
+//   DotStrip dotRgb(60);
+//   BasicPattern<DotStrip> pattern(&dotRgb);
+//
+// Pattern draws on any ColorStrip, through its virtual methods.
 
-class Pattern {
+template<typename StripT>
+class BasicPattern {
   public:
-    inline Pattern(ColorStrip* strip, String event_name="") :
-        strip(strip) {
+    inline BasicPattern(StripT* strip, String event_name="") :
+        frameTime(0),
+        cycleStart(0),
+        blob(this->inlineBlobs),
+        blobCount(BLOB_COUNT),
+        strip(strip),
+        nextDraw(micros()) {
 
       // Start off by turning the strip off.
       this->active.pattern = SOLID;
@@ -120,6 +153,10 @@ class Pattern {
       this->reset_workingstate();
     }
 
+    inline ~BasicPattern() {
+      this->freeBlobs();
+    }
+
     inline PatternDescription getPattern() {
       return this->active;
     }
@@ -132,13 +169,70 @@ class Pattern {
       this->next = next;
     }
 
+    // Switch to a pattern now, mid cycle, instead of waiting for a clean
+    // break. Its first frame is due straight away.
+    inline void startPattern(const PatternDescription &pattern) {
+      this->active = pattern;
+      this->next.pattern = PATTERN_COUNT;
+      this->reset_workingstate();
+      this->nextDraw = micros();
+    }
+
+    // Remove the pattern waiting for a clean break, if there is one.
+    inline bool takeNextPattern(PatternDescription* next) {
+      if (this->next.pattern == PATTERN_COUNT)
+        return false;
+
+      *next = this->next;
+      this->next.pattern = PATTERN_COUNT;
+      return true;
+    }
+
+    // Number of blobs drawn by LAVA. Resets the working state, so it's best
+    // called before the pattern starts. Up to BLOB_COUNT blobs are kept in
+    // the pattern, more are allocated. Returns false, leaving no blobs, if
+    // the allocation fails, or false and no change for a negative count.
+    inline bool setBlobCount(int count) {
+      if (count < 0)
+        return false;
+
+      this->freeBlobs();
+      this->blob = this->inlineBlobs;
+      this->blobCount = count;
+
+      if (count > BLOB_COUNT) {
+        this->blob = (Blob*)calloc(count, sizeof(Blob));
+
+        if (!this->blob) {
+          this->blob = this->inlineBlobs;
+          this->blobCount = 0;
+        }
+      }
+
+      this->reset_workingstate();
+      return this->blobCount == count;
+    }
+
+    inline int getBlobCount() { return this->blobCount; }
+
+    // micros() time at which the next frame is due.
+    inline system_tick_t getNextDraw() {
+      return this->nextDraw;
+    }
+
     // Returns true, if the Pattern was updated.
     inline bool drawUpdate() {
-      unsigned long now = millis();
+      system_tick_t now = micros();
 
-      if (now < this->nextDraw)
+      // Signed difference, so this survives micros() wrapping.
+      if ((int32_t)(now - this->nextDraw) < 0)
         return false;
 
+      this->frameTime = now;
+      if (this->initial) {
+        this->cycleStart = now;
+      }
+
       bool next_ready = false;
 
       switch (this->active.pattern) {
@@ -167,14 +261,26 @@ class Pattern {
       }
 
       this->initial = false;
+
+      // Handlers schedule against their own timeline, so a late frame doesn't
+      // delay the ones after it. The strip's frame rate limit drops any
+      // frames that come too quickly.
+      if (this->delay < this->strip->getFrameInterval()) {
+        this->delay = this->strip->getFrameInterval();
+      }
+      if (this->delay > PATTERN_MAX_DELAY) {
+        this->delay = PATTERN_MAX_DELAY;
+      }
       this->nextDraw = now + this->delay;
 
       if (next_ready &&
           this->next.pattern != PATTERN_COUNT) {
-        // Switch to next pattern, reset next.
+        // Switch to next pattern, reset next. Its first frame is due now,
+        // not when the old pattern's next step would have been.
         this->active = this->next;
         this->next.pattern = PATTERN_COUNT;
         this->reset_workingstate();
+        this->nextDraw = now;
 
         return true;
       }
@@ -194,18 +300,45 @@ class Pattern {
       this->position = 0;
 
       for (Blob *b = this->blob;
-           b < (this->blob + BLOB_COUNT);
+           b < (this->blob + this->blobCount);
            b++) {
         b->pos = -1;
+        b->duration = 0;
       }
     }
 
-    inline bool handle_solid() {
-      if (this->delay == 0) {
-        this->delay = this->active.speed;
-      }
+    // Same as ColorStrip::drawSolid(), but calls finishDraw() on StripT.
+    inline void drawSolid(Color color) {
+      this->strip->fillRange(0, this->strip->getPixelCount(), color);
+      this->strip->finishDraw();
+    }
+
+    // us since the start of the current animation cycle.
+    inline uint32_t elapsed() {
+      return this->frameTime - this->cycleStart;
+    }
 
-      this->strip->drawSolid(expandSpecial(this->active.a));
+    // The pattern speed divided into steps, in us (never 0).
+    inline uint32_t speedStep(uint32_t steps=1) {
+      int speed = this->active.speed > 0 ? this->active.speed : 0;
+      uint64_t step = (uint64_t)speed * 1000 / (steps ? steps : 1);
+      if (step > 0xFFFFFFFF)
+        step = 0xFFFFFFFF;
+      return step ? step : 1;
+    }
+
+    // Count the whole steps since the cycle started, and move the cycle start
+    // up to the last of them. Schedules the next draw for the next step.
+    inline uint32_t consumeSteps(uint32_t step) {
+      uint32_t steps = this->elapsed() / step;
+      this->cycleStart += steps * step;
+      this->delay = step - this->elapsed();
+      return steps;
+    }
+
+    inline bool handle_solid() {
+      this->delay = this->speedStep();
+      this->drawSolid(expandSpecial(this->active.a));
       return true;
     }
 
@@ -214,30 +347,33 @@ class Pattern {
       bool next_ready = false;
 
       if (this->initial) {
-        this->delay = this->active.speed / steps;
-      }
-
-      // Bounce directions, if needed.
-      if (this->position >= steps) {
-        this->go_right = false;
         this->a = expandSpecial(this->active.a);
+        this->b = expandSpecial(this->active.b);
       }
-      if (this->position <= 0) {
-        this->go_right = true;
+
+      // Morph to B over the first half of the cycle, and back over the second.
+      uint32_t half = this->speedStep(2);
+      if (this->consumeSteps(half * 2)) {
         this->b = expandSpecial(this->active.b);
-        next_ready = !this->initial;
+        next_ready = true;
       }
 
-      float ratio = this->position / (float)steps;
-      Color drawColor = mixColor(this->a, this->b, ratio);
-      this->strip->drawSolid(drawColor);
+      uint32_t time = this->elapsed();
+      bool rising = time < half;
 
-      // Increment.
-      if (this->go_right) {
-        this->position++;
-      } else {
-        this->position--;
+      // Pick a new A at the top, while B is showing.
+      if (!rising && this->go_right) {
+        this->a = expandSpecial(this->active.a);
       }
+      this->go_right = rising;
+
+      uint32_t fromA = rising ? time : half * 2 - time;
+      ColorRatio ratio = (uint64_t)fromA * RATIO_ONE / half;
+      this->drawSolid(lerpColor(this->a, this->b, ratio));
+
+      // Aim for one frame per shade.
+      uint32_t step = half / steps ? half / steps : 1;
+      this->delay = step - time % step;
 
       return next_ready;
     }
@@ -246,63 +382,73 @@ class Pattern {
       if (this->initial) {
         this->a = expandSpecial(this->active.a);
         this->b = expandSpecial(this->active.b);
-        this->c = mixColor(this->a, this->b, 0.95);
+        this->c = lerpColor(this->a, this->b, RATIO_ONE * 95 / 100);
       }
 
-      bool next_ready = false;
-      this->delay = (this->active.speed / (this->strip->getPixelCount() * 2));
+      int pixelCount = this->strip->getPixelCount();
 
-      // Bounce directions, if needed. Delay longer at the bounce.
-      if (this->position >= (this->strip->getPixelCount()-1)) {
-        this->go_right = false;
-        this->delay = this->delay * 3;
-      }
+      // The eye moves one pixel per step, and waits 3 steps at each end. A
+      // full cycle (there and back) is 2 * pixelCount + 2 steps.
+      uint32_t step = this->speedStep(pixelCount * 2);
+      uint32_t cycleSteps = pixelCount > 1 ? pixelCount * 2 + 2 : 6;
 
-      if (this->position <= 0) {
-        this->go_right = true;
-        this->delay = this->delay * 3;
-        next_ready = !initial;
-      }
+      bool next_ready = this->consumeSteps(step * cycleSteps) != 0;
 
-      // Do the draw.
-      for (int i = 0; i < this->strip->getPixelCount(); i++) {
-        if (i == this->position - 1) {
-          this->strip->drawPixel(this->c);
-        } else if (i == this->position) {
-          this->strip->drawPixel(this->a);
-        } else if (i == this->position + 1) {
-          this->strip->drawPixel(this->c);
-        } else {
-          this->strip->drawPixel(this->b);
-        }
+      uint32_t u = this->elapsed() / step;
+      uint32_t until;
+      int last = this->position;
+
+      if (pixelCount < 2) {
+        this->position = 0;
+        until = cycleSteps;
+      } else if (u < 3) {
+        this->position = 0;
+        until = 3;
+      } else if (u < (uint32_t)pixelCount + 1) {
+        this->position = u - 2;
+        until = u + 1;
+      } else if (u < (uint32_t)pixelCount + 4) {
+        this->position = pixelCount - 1;
+        until = pixelCount + 4;
+      } else {
+        this->position = cycleSteps - u;
+        until = u + 1;
       }
-      this->strip->finishDraw();
 
-      // Increment.
-      if (this->go_right) {
-        this->position++;
+      this->delay = until * step - this->elapsed();
+
+      // Do the draw. Only the old and new eye need updating.
+      if (this->initial) {
+        this->strip->fillRange(0, pixelCount, this->b);
       } else {
-        this->position--;
+        this->strip->fillRange(last - 1, 3, this->b);
       }
 
+      this->strip->fillRange(this->position - 1, 3, this->c);
+      this->strip->fillRange(this->position, 1, this->a);
+      this->strip->finishDraw();
+
       return next_ready;
     }
 
     inline bool handle_alternate() {
       if (this->initial) {
-        this->delay = this->active.speed;
         this->a = expandSpecial(this->active.a);
         this->b = expandSpecial(this->active.b);
       }
 
+      if (this->consumeSteps(this->speedStep()) & 1) {
+        this->go_right = !this->go_right;
+      }
+
       for (int i = 0; i < this->strip->getPixelCount(); i++) {
         Color pixelColor = ((i % 2) == this->go_right) ? this->a : this->b;
-        this->strip->drawPixel(pixelColor);
+        this->strip->setPixel(i, pixelColor);
       }
       this->strip->finishDraw();
 
-      this->go_right = !this->go_right;
-      return this->go_right;
+      // The cycle ends after the second color.
+      return !this->go_right;
     }
 
     // This attempts to simulate a light with a poor electrical connection (often
@@ -316,8 +462,6 @@ class Pattern {
       // this->active.speed    The range over which 'connection' can move.
 
       if (this->initial) {
-        this->delay = 10;
-
         this->a = expandSpecial(this->active.a);
         this->b = expandSpecial(this->active.b);
 
@@ -326,26 +470,34 @@ class Pattern {
 
       bool next_ready = false;
 
-      // -10, 0, 10  (steps of 10 used increase standard speeds)
-      this->position += random(-1, 2) * 10;
-
-      // Ensure this->position remains in range.
-      if (this->position < 0) {
-        this->position = 0;
-        this->a = expandSpecial(this->active.a);
+      // One step of the walk per tick, including any ticks missed.
+      uint32_t ticks = this->consumeSteps(PATTERN_TICK) + this->initial;
+      if (ticks > PATTERN_MAX_TICKS) {
+        ticks = PATTERN_MAX_TICKS;
       }
 
-      if (this->position > this->active.speed) {
-        this->position = this->active.speed;
-        this->b = expandSpecial(this->active.b);
-        next_ready = true;
+      for (uint32_t t = 0; t < ticks; t++) {
+        // -10, 0, 10  (steps of 10 used increase standard speeds)
+        this->position += random(-1, 2) * 10;
+
+        // Ensure this->position remains in range.
+        if (this->position < 0) {
+          this->position = 0;
+          this->a = expandSpecial(this->active.a);
+        }
+
+        if (this->position > this->active.speed) {
+          this->position = this->active.speed;
+          this->b = expandSpecial(this->active.b);
+          next_ready = true;
+        }
       }
 
       bool new_go_right = this->position >= (this->active.speed / 2);
 
-      if (new_go_right != this->go_right) {
+      if (new_go_right != this->go_right || this->initial) {
         this->go_right = new_go_right;
-        this->strip->drawSolid(this->go_right ? this->a : this->b);
+        this->drawSolid(this->go_right ? this->a : this->b);
       }
 
       return next_ready;
@@ -354,110 +506,141 @@ class Pattern {
     inline bool handle_lava() {
       // Intialize all of our blobs to be off screen (so to speak).
       if (this->initial) {
-        this->delay = 10;
         this->b = expandSpecial(this->active.b);
 
         // Initialize the strip.
-        this->strip->drawSolid(BLACK);
+        this->drawSolid(BLACK);
       }
 
       // Read-Only.
       int pixelCount = this->strip->getPixelCount();
-      Color *pixelBuffer = this->strip->getPixelBuffer();
+
+      // Blobs change once per tick, including any ticks missed.
+      uint32_t ticks = this->consumeSteps(PATTERN_TICK) + this->initial;
+      if (ticks > PATTERN_MAX_TICKS) {
+        ticks = PATTERN_MAX_TICKS;
+      }
 
       // Mutate our blobs.
-      for (Blob *b = this->blob; b < (this->blob + BLOB_COUNT); b++) {
-        b->duration--;
+      for (Blob *b = this->blob; b < (this->blob + this->blobCount); b++) {
+        b->duration -= ticks;
+        if (b->duration > 0)
+          continue;
 
         // If it's not currently displayed.
         if (b->pos == -1) {
-          if (b->duration <= 0) {
-            b->pos = random(pixelCount);
-            b->size = pixelCount - log(random(exp(pixelCount)));
-            b->duration = random(this->active.speed);
-            b->color = expandSpecial(this->active.a);
-          }
+          b->pos = random(pixelCount);
+          b->size = randomBlobSize();
+          b->duration = random(this->active.speed);
+          b->color = expandSpecial(this->active.a);
         } else {
-          if (b->duration <= 0) {
-            b->pos = -1;
-            b->duration = random(this->active.speed);
-          }
+          b->pos = -1;
+          b->duration = random(this->active.speed);
         }
       }
 
-      this->position++;
-      bool backgroundFade = (this->position >= 3);
-      if (backgroundFade) {
-        this->position = 0;
-      }
+      // The background fades one shade every 3 ticks.
+      this->position += ticks;
+      int fades = this->position / 3;
+      this->position %= 3;
 
-      for (int p = 0; p < pixelCount; p++) {
-        Color pixel = pixelBuffer[p];
+      if (fades) {
+        for (int p = 0; p < pixelCount; p++) {
+          Color pixel = this->strip->getPixel(p);
+          for (int f = 0; f < fades; f++) {
+            pixel = morphColor(pixel, this->b);
+          }
+          this->strip->setPixel(p, pixel);
+        }
+      }
 
-        if (backgroundFade) {
-          pixel = morphColor(pixel, this->b);
+      // Morph the pixels inside each blob, (pos - size, pos + size) wrapping
+      // around the ends of the strip, towards the blob color.
+      for (Blob *b = this->blob; b < (this->blob + this->blobCount); b++) {
+        int length = b->size * 2 - 1;
+        if (length > pixelCount) {
+          length = pixelCount;
         }
 
-        for (Blob *b = this->blob; b < (this->blob + BLOB_COUNT); b++) {
-          if (b->pos == -1)
-            continue;
+        if (b->pos == -1 || length < 1)
+          continue;
 
-          int bMin = b->pos - b->size;
-          int bMax = b->pos + b->size;
+        int p = (b->pos - b->size + 1) % pixelCount;
+        if (p < 0) {
+          p += pixelCount;
+        }
 
-          // Is p inside the blob range, including wrapping.
-          if (((p - pixelCount) > bMin && (p - pixelCount) < bMax) ||
-              (p > bMin && p < bMax) ||
-              ((p + pixelCount) > bMin && (p + pixelCount) < bMax)) {
-            pixel = morphColor(pixel, b->color);
+        for (int i = 0; i < length; i++) {
+          this->strip->setPixel(p, morphColor(this->strip->getPixel(p),
+                                              b->color));
+          if (++p == pixelCount) {
+            p = 0;
           }
         }
-
-        this->strip->drawPixel(pixel);
       }
 
       this->strip->finishDraw();
       return true;
     }
 
+    // Blob radius, exponentially distributed with a mean of about 1 pixel.
+    static inline int randomBlobSize() {
+      return -log((random(0x10000) + 1) / 65536.0);
+    }
+
     inline bool handle_test() {
       static int COLOR_COUNT = 4;
       static Color colors[] = {RED, GREEN, BLUE, WHITE};
 
-      // If go_right == true draw SOLID colors.
-      //    colors index = position.
-      // if go_right == false draw one pixel with color.
-      //    pixel       = position / COLOR_COUNT
-      //    color index = position % COLOR_COUNT
-
-      int max_position = this->go_right ?
-          COLOR_COUNT : this->strip->getPixelCount() * COLOR_COUNT;
+      // Each color is drawn SOLID for speed ms, then each color on each
+      // pixel in turn for speed / 2 ms.
+      int pixelCount = this->strip->getPixelCount();
+      uint32_t solidStep = this->speedStep();
+      uint32_t pixelStep = this->speedStep(2);
+
+      // go_right is true while drawing SOLID colors, and position counts
+      // steps within the SOLID or pixel phase.
+      bool wasSolid = this->go_right || this->initial;
+      int last = this->position / COLOR_COUNT;
+
+      // Move through the cycle a phase at a time, keeping cycleStart at the
+      // start of the current step. A whole cycle on a long strip can last
+      // longer than micros() counts.
+      uint32_t step;
+      for (;;) {
+        step = this->go_right ? solidStep : pixelStep;
+        int phaseSteps = COLOR_COUNT * (this->go_right ? 1 : pixelCount);
+        uint32_t steps = this->elapsed() / step;
+
+        if (steps < (uint32_t)(phaseSteps - this->position)) {
+          this->position += steps;
+          this->cycleStart += steps * step;
+          break;
+        }
 
-      if (this->position >= max_position) {
-        this->go_right = !this->go_right;
+        this->cycleStart += (phaseSteps - this->position) * step;
         this->position = 0;
+        this->go_right = !this->go_right;
       }
 
+      this->delay = step - this->elapsed();
+
       if (this->go_right) {
-        this->strip->drawSolid(colors[this->position]);
-        this->delay = this->active.speed;
+        this->drawSolid(colors[this->position]);
       } else {
         int pixel = this->position / COLOR_COUNT;
         int color_index = this->position % COLOR_COUNT;
 
-        for (int i = 0; i < this->strip->getPixelCount(); i++) {
-          if (i == pixel) {
-            this->strip->drawPixel(colors[color_index]);
-          } else {
-            this->strip->drawPixel(BLACK);
-          }
+        // Only the last lit pixel needs clearing.
+        if (wasSolid) {
+          this->strip->fillRange(0, pixelCount, BLACK);
+        } else {
+          this->strip->setPixel(last, BLACK);
         }
+        this->strip->setPixel(pixel, colors[color_index]);
         this->strip->finishDraw();
-
-        this->delay = this->active.speed / 2;
       }
 
-      this->position++;
       return true;
     }
 
@@ -471,8 +654,10 @@ class Pattern {
     // Working values for all patterns.
 
     // Shared State between Pattern, and handler method.
-    unsigned long delay;  // Delay before next draw.
-    bool initial;         // Is this the first iteration for the pattern.
+    unsigned long delay;       // Delay before next draw, in us.
+    bool initial;              // Is this the first iteration for the pattern.
+    system_tick_t frameTime;   // micros() time of the frame being drawn.
+    system_tick_t cycleStart;  // micros() time the animation cycle started.
 
     // Provided for handler methods.
     Color a;
@@ -481,14 +666,32 @@ class Pattern {
     bool go_right;
     int position;
 
-    Blob blob[BLOB_COUNT];
+    Blob* blob;
+    int blobCount;
+    Blob inlineBlobs[BLOB_COUNT];
 
     // Member variables.
-    ColorStrip* strip;
+    StripT* strip;
     PatternDescription active;
     PatternDescription next;
 
-    unsigned long nextDraw;
+    system_tick_t nextDraw;
+
+  private:
+    // Free the blobs, if they were allocated.
+    inline void freeBlobs() {
+      if (this->blob != this->inlineBlobs)
+        free(this->blob);
+    }
+
+    BasicPattern(const BasicPattern&);
+    BasicPattern& operator=(const BasicPattern&);
+};
+
+class Pattern : public BasicPattern<ColorStrip> {
+  public:
+    inline Pattern(ColorStrip* strip, String event_name="") :
+        BasicPattern<ColorStrip>(strip, event_name) {}
 };
 
 #endif
@@ -0,0 +1,210 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include "scheduler.h"
+
+//
+// Draws patterns on a thread of their own (Photon and later), so delays in
+// loop(), or in the cloud, don't hold up animation.
+//
+// The render thread owns its patterns. Changes to them are queued with
+// setPattern(), and applied on the render thread before its next update, so
+// drawUpdate() never sees a half written PatternDescription.
+//
+//   PatternRenderer renderer;
+//
+//   void setup() {
+//     renderer.add(&stripPattern, publishStrip);
+//     renderer.start();
+//   }
+//
+//   int setStrip(String text) {
+//     PatternDescription next;
+//     if (!parsePattern(text.c_str(), &next))
+//       return -1;
+//     return renderer.setPattern(&stripPattern, next) ? 0 : -1;
+//   }
+//
+// setPattern() must always be called from the same thread. loop() and cloud
+// functions both run on the application thread, so either can call it.
+// PatternUpdated callbacks run on the render thread.
+//
+
+#if PLATFORM_THREADING
+
+#include <atomic>
+
+// Pattern changes that can be waiting for the render thread.
+#define RENDER_QUEUE_SIZE (16)
+
+// Longest the render thread sleeps before checking for changes, in ms.
+#define RENDER_POLL_MS (10)
+
+// Above the application thread, so it can preempt a busy loop().
+#define RENDER_THREAD_PRIORITY (OS_THREAD_PRIORITY_DEFAULT + 1)
+#define RENDER_THREAD_STACK (OS_THREAD_STACK_SIZE_DEFAULT)
+
+// Lock free ring, for one thread to push() and another to pop(). Each index
+// is only written by one side, so neither ever waits for the other.
+template<typename T, int SIZE>
+class SpscQueue {
+  static_assert(SIZE > 0 && (SIZE & (SIZE - 1)) == 0,
+                "SpscQueue size must be a power of two");
+
+  public:
+    inline SpscQueue() : head(0), tail(0) {}
+
+    // Returns false if the queue is full.
+    inline bool push(const T& item) {
+      uint32_t tail = this->tail.load(std::memory_order_relaxed);
+      if (tail - this->head.load(std::memory_order_acquire) == SIZE)
+        return false;
+
+      this->items[tail & (SIZE - 1)] = item;
+      this->tail.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    // Returns false if the queue is empty.
+    inline bool pop(T* item) {
+      uint32_t head = this->head.load(std::memory_order_relaxed);
+      if (head == this->tail.load(std::memory_order_acquire))
+        return false;
+
+      *item = this->items[head & (SIZE - 1)];
+      this->head.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+  private:
+    T items[SIZE];
+    std::atomic<uint32_t> head;  // Next item to pop.
+    std::atomic<uint32_t> tail;  // Next slot to push.
+};
+
+template<typename PatternT>
+class BasicPatternRenderer {
+  public:
+    typedef typename BasicPatternScheduler<PatternT>::PatternUpdated
+        PatternUpdated;
+
+    inline BasicPatternRenderer() : running(false), thread(NULL) {}
+
+    inline ~BasicPatternRenderer() {
+      this->stop();
+    }
+
+    // Patterns can only be added before start(). Returns false if they can't.
+    inline bool add(PatternT* pattern, PatternUpdated updated=NULL) {
+      if (this->thread)
+        return false;
+
+      return this->scheduler.add(pattern, updated);
+    }
+
+    // Start the render thread. Returns false if it's already running.
+    inline bool start(os_thread_prio_t priority=RENDER_THREAD_PRIORITY,
+                      size_t stackSize=RENDER_THREAD_STACK) {
+      if (this->thread)
+        return false;
+
+      this->running.store(true, std::memory_order_release);
+      this->thread = new Thread("render", run, this, priority, stackSize);
+      return true;
+    }
+
+    // Wait for the render thread to finish its current update, and exit.
+    inline void stop() {
+      if (!this->thread)
+        return;
+
+      this->running.store(false, std::memory_order_release);
+      this->thread->join();
+      delete this->thread;
+      this->thread = NULL;
+    }
+
+    inline bool isRunning() { return this->thread != NULL; }
+
+    // Queue a change of pattern. It's passed to pattern->setPattern() on the
+    // render thread, so it takes effect at the end of the current animation
+    // cycle, as usual. Returns false if the queue is full.
+    inline bool setPattern(PatternT* pattern, const PatternDescription& next) {
+      Command command = { pattern, next };
+      return this->commands.push(command);
+    }
+
+    inline bool setPattern(PatternT* pattern,
+                           PatternType type, Color a, Color b, int speed) {
+      return this->setPattern(pattern, PatternDescription(type, a, b, speed));
+    }
+
+  private:
+    typedef struct Command {
+      PatternT* pattern;
+      PatternDescription next;
+    } Command;
+
+    // A thread function mustn't return on a device, so ends the thread.
+    static inline os_thread_return_t run(void* param) {
+      ((BasicPatternRenderer*)param)->loop();
+      os_thread_exit(NULL);
+    }
+
+    inline void loop() {
+      while (this->running.load(std::memory_order_acquire)) {
+        Command command;
+        bool changed = false;
+        while (this->commands.pop(&command)) {
+          command.pattern->setPattern(command.next);
+          changed = true;
+        }
+
+        if (changed) {
+          this->scheduler.reschedule();
+        }
+
+        unsigned long wait = this->scheduler.drawUpdate();
+        if (wait > RENDER_POLL_MS) {
+          wait = RENDER_POLL_MS;
+        }
+
+        // A frame due in under 1ms.
+        if (wait) {
+          delay(wait);
+        } else {
+          os_thread_yield();
+        }
+      }
+    }
+
+    BasicPatternScheduler<PatternT> scheduler;
+    SpscQueue<Command, RENDER_QUEUE_SIZE> commands;
+    std::atomic<bool> running;
+    Thread* thread;
+};
+
+typedef BasicPatternRenderer<Pattern> PatternRenderer;
+
+#endif
+
+#endif
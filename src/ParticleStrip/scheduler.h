@@ -0,0 +1,189 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "patterns.h"
+
+//
+// Drives many Patterns from one place, instead of calling drawUpdate() on
+// each of them every loop().
+//
+// Patterns are kept in a min-heap by the time their next frame is due, so
+// each drawUpdate() only touches patterns that are due. It returns the number
+// of ms until the next frame is needed, so the application can sleep or do
+// other work until then.
+//
+//   PatternScheduler scheduler;
+//
+//   void setup() {
+//     scheduler.add(&stripPattern, publishStrip);
+//     scheduler.add(&ringPattern);
+//   }
+//
+//   void loop() {
+//     delay(scheduler.drawUpdate());
+//   }
+//
+// All deadline comparisons are wrap safe, since a Pattern never schedules a
+// frame more than PATTERN_MAX_DELAY away.
+//
+// PatternScheduler drives Patterns. To drive patterns on a known strip type,
+// use BasicPatternScheduler<BasicPattern<DotStrip> > (or similar).
+//
+
+#define SCHEDULER_MAX_PATTERNS (16)
+
+// Returned by drawUpdate() if no patterns are scheduled, in ms. Short, so a
+// loop() sleeping on it soon draws patterns added later (eg: by a cloud
+// function).
+#define SCHEDULER_IDLE_DELAY (100)
+
+template<typename PatternT>
+class BasicPatternScheduler {
+  public:
+    // Called after a pattern switches to a new PatternDescription.
+    typedef void (*PatternUpdated)(PatternT* pattern);
+
+    inline BasicPatternScheduler() : count(0) {}
+
+    // Returns false if the scheduler is full.
+    inline bool add(PatternT* pattern, PatternUpdated updated=NULL) {
+      if (this->count >= SCHEDULER_MAX_PATTERNS)
+        return false;
+
+      Entry entry = { pattern, updated };
+      this->push(entry);
+      return true;
+    }
+
+    // Draw every pattern that is due, and return the ms until the next
+    // pattern is due.
+    inline unsigned long drawUpdate() {
+      system_tick_t now = micros();
+
+      // Take all due patterns off the heap first, so each draws at most once
+      // per call, even if it has no delay between frames.
+      Entry due[SCHEDULER_MAX_PATTERNS];
+      int dueCount = 0;
+
+      while (this->count && isDue(this->heap[0].pattern, now)) {
+        due[dueCount++] = this->pop();
+      }
+
+      for (int i = 0; i < dueCount; i++) {
+        if (due[i].pattern->drawUpdate() && due[i].updated) {
+          due[i].updated(due[i].pattern);
+        }
+        this->push(due[i]);
+      }
+
+      return this->timeUntilNextDraw();
+    }
+
+    // ms until the next pattern is due (0 if one is due now). Rounded down,
+    // so sleeping for it never misses a frame.
+    inline unsigned long timeUntilNextDraw() {
+      if (!this->count)
+        return SCHEDULER_IDLE_DELAY;
+
+      int32_t remaining = this->heap[0].pattern->getNextDraw() - micros();
+      return remaining < 0 ? 0 : remaining / 1000;
+    }
+
+    inline int getPatternCount() { return this->count; }
+
+    // Call after a pattern's next draw moves outside of drawUpdate() (eg: a
+    // CrossfadePattern given a new pattern), to keep the heap in order. There
+    // are few patterns, so the heap is just rebuilt.
+    inline void reschedule() {
+      Entry entries[SCHEDULER_MAX_PATTERNS];
+      int entryCount = this->count;
+      memcpy(entries, this->heap, sizeof(Entry) * entryCount);
+
+      this->count = 0;
+      for (int i = 0; i < entryCount; i++) {
+        this->push(entries[i]);
+      }
+    }
+
+  private:
+    typedef struct Entry {
+      PatternT* pattern;
+      PatternUpdated updated;
+    } Entry;
+
+    static inline bool isDue(PatternT* pattern, system_tick_t now) {
+      return (int32_t)(now - pattern->getNextDraw()) >= 0;
+    }
+
+    static inline bool before(const Entry& left, const Entry& right) {
+      return (int32_t)(left.pattern->getNextDraw() -
+                       right.pattern->getNextDraw()) < 0;
+    }
+
+    inline void push(Entry entry) {
+      int child = this->count++;
+
+      while (child > 0) {
+        int parent = (child - 1) / 2;
+        if (!before(entry, this->heap[parent]))
+          break;
+
+        this->heap[child] = this->heap[parent];
+        child = parent;
+      }
+
+      this->heap[child] = entry;
+    }
+
+    inline Entry pop() {
+      Entry top = this->heap[0];
+      Entry last = this->heap[--this->count];
+
+      int parent = 0;
+      while (true) {
+        int child = parent * 2 + 1;
+        if (child >= this->count)
+          break;
+
+        if (child + 1 < this->count &&
+            before(this->heap[child + 1], this->heap[child])) {
+          child++;
+        }
+
+        if (!before(this->heap[child], last))
+          break;
+
+        this->heap[parent] = this->heap[child];
+        parent = child;
+      }
+
+      this->heap[parent] = last;
+      return top;
+    }
+
+    Entry heap[SCHEDULER_MAX_PATTERNS];
+    int count;
+};
+
+typedef BasicPatternScheduler<Pattern> PatternScheduler;
+
+#endif
@@ -0,0 +1,343 @@
+/*-------------------------------------------------------------------------
+  ParticleStrip is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  ParticleStrip is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with ParticleStrip.  If not, see
+  <http://www.gnu.org/licenses/>.
+
+  The original version of ParticleStrip is available at:
+      'https://github.com/DonGar/particle-strip
+  -------------------------------------------------------------------------*/
+
+#ifndef SPI_OUTPUT_H
+#define SPI_OUTPUT_H
+
+#include <application.h>
+
+#include "gpio-port.h"
+
+//
+// Wire buffers and SPI transmission shared by the clocked strips (DigitalStrip
+// and DotStrip).
+//
+// A strip encodes each frame into "buffer()", then calls "send()" to transmit
+// it in a single bulk transfer. Bytes the strip never encodes (latch, start
+// and end frames) are zero from construction onwards.
+//
+// Normally "send()" blocks until the whole buffer has been clocked out. In
+// async mode there are two wire buffers. "send()" starts a DMA transfer and
+// returns immediately, and the next frame is encoded into the other buffer
+// while the previous one is still transmitting. "buffer()" is never the one
+// in flight.
+//
+// The wire buffers are allocated by the constructor, unless storage of
+// storageSize() bytes is given. If allocation fails, buffer() is NULL and
+// nothing can be sent.
+//
+// Frames are sent on a SpiBus: SPI, SPI1, or software SPI on any two pins.
+// Strips on different hardware buses send at the same time. Strips sharing a
+// bus take turns, and each one's clock speed and mode are set again before it
+// sends, if another strip used the bus in between.
+//
+// Software SPI is always blocking. It shifts each byte out with 8 unrolled
+// pairs of port register writes, as fast as the CPU allows unless a clock
+// speed is given.
+//
+// A hardware bus only runs at its peripheral clock divided by a power of two,
+// so the speed given is rounded down to one of those (see spiBusClock).
+//
+
+// Hardware buses run at their peripheral clock divided by this, unless a
+// strip asks for a clock speed.
+#define SPI_OUTPUT_DEFAULT_DIVIDER (8)
+
+// Hardware buses, by index (see SpiBus::index).
+#if Wiring_SPI1
+#define SPI_OUTPUT_BUSES (2)
+#else
+#define SPI_OUTPUT_BUSES (1)
+#endif
+
+// Peripheral clock a hardware bus divides down, in Hz. SPI is on APB2, and
+// SPI1 on APB1.
+constexpr unsigned spiReferenceClock(int bus) {
+#if defined(PLATFORM_ID) && PLATFORM_ID == 0
+  return 72000000;
+#else
+  return bus ? 30000000 : 60000000;
+#endif
+}
+
+// The clock a hardware bus runs at when asked for "speed" Hz. Like the HAL,
+// this is the reference divided by the smallest power of two from 2 to 256
+// that doesn't exceed the speed.
+constexpr unsigned spiBusClock(int bus, unsigned speed, unsigned divider=2) {
+  return (divider >= 256 || spiReferenceClock(bus) / divider <= speed) ?
+      spiReferenceClock(bus) / divider :
+      spiBusClock(bus, speed, divider * 2);
+}
+
+// The clock a hardware bus runs at for strips that don't give a speed.
+constexpr unsigned spiDefaultClock(int bus) {
+  return spiReferenceClock(bus) / SPI_OUTPUT_DEFAULT_DIVIDER;
+}
+
+// Where a clocked strip is connected. Converts from SPI or SPI1, eg:
+//
+//   DotStrip strip(60, false, PIXEL_COLOR, SPI1);
+//   DotStrip strip(60, false, PIXEL_COLOR, SpiBus(SPI, 4 * MHZ));
+//   DotStrip strip(60, false, PIXEL_COLOR, SpiBus(D0, D1));
+//
+// clockSpeed is in Hz. 0 runs a hardware bus at spiDefaultClock(), or
+// software SPI at full speed.
+class SpiBus {
+  public:
+    inline SpiBus(SPIClass& spi=SPI, unsigned clockSpeed=0) :
+        spi(&spi),
+        clockPin(-1),
+        dataPin(-1),
+        clockSpeed(clockSpeed) {}
+
+    // Software SPI. Data is valid on the rising clock edge (SPI mode 0).
+    inline SpiBus(int clockPin, int dataPin, unsigned clockSpeed=0) :
+        spi(NULL),
+        clockPin(clockPin),
+        dataPin(dataPin),
+        clockSpeed(clockSpeed) {}
+
+    inline bool isSoftware() const { return !this->spi; }
+
+    // Index of a hardware bus, for per bus state.
+    inline int index() const {
+#if Wiring_SPI1
+      if (this->spi == &SPI1)
+        return 1;
+#endif
+      return 0;
+    }
+
+    SPIClass* spi;
+    int clockPin;
+    int dataPin;
+    unsigned clockSpeed;
+};
+
+// Set while an async transfer is in progress on each hardware bus. Shared by
+// every strip on a bus, since a bus can only run one transfer at a time.
+inline volatile bool* spiOutputBusy() {
+  static volatile bool busy[SPI_OUTPUT_BUSES];
+  return busy;
+}
+
+// DMA completion callback for a bus.
+template<int BUS>
+inline void spiOutputDone() {
+  spiOutputBusy()[BUS] = false;
+}
+
+class SpiOutput;
+
+// The SpiOutput whose settings each hardware bus has, if any.
+inline SpiOutput** spiOutputOwner() {
+  static SpiOutput* owner[SPI_OUTPUT_BUSES];
+  return owner;
+}
+
+class SpiOutput {
+  public:
+    inline SpiOutput(int size, bool async, uint8_t* storage=NULL,
+                     const SpiBus& bus=SpiBus()) :
+        size(size),
+        async(async && !bus.isSoftware()),
+        back(0),
+        allocated(NULL),
+        bus(bus),
+        clockPort(NULL),
+        dataPort(NULL),
+        clockMask(0),
+        dataMask(0),
+        halfTicks(0) {
+      if (storage) {
+        memset(storage, 0, storageSize(size, async));
+      } else {
+        storage = (uint8_t*)calloc(storageSize(size, async), 1);
+        this->allocated = storage;
+      }
+
+      this->buffers[0] = storage;
+      this->buffers[1] = this->async && storage ? storage + size : NULL;
+    }
+
+    // Waits for a frame still being sent from the buffers.
+    inline ~SpiOutput() {
+      this->waitForSend();
+
+      if (!this->bus.isSoftware() &&
+          spiOutputOwner()[this->bus.index()] == this) {
+        spiOutputOwner()[this->bus.index()] = NULL;
+      }
+      free(this->allocated);
+    }
+
+    // Bytes of storage for wire buffers of size bytes.
+    static constexpr int storageSize(int size, bool async) {
+      return async ? size * 2 : size;
+    }
+
+    // Set up the bus. Settings are applied when a frame is sent.
+    inline void begin() {
+      if (this->bus.isSoftware()) {
+        const STM32_Pin_Info* pins = HAL_Pin_Map();
+        this->clockPort = pins[this->bus.clockPin].gpio_peripheral;
+        this->clockMask = pins[this->bus.clockPin].gpio_pin;
+        this->dataPort = pins[this->bus.dataPin].gpio_peripheral;
+        this->dataMask = pins[this->bus.dataPin].gpio_pin;
+
+        // Half a clock period, in cycle counter ticks.
+        this->halfTicks = this->bus.clockSpeed ?
+            System.ticksPerMicrosecond() * 500000 / this->bus.clockSpeed : 0;
+
+        pinMode(this->bus.clockPin, OUTPUT);
+        pinMode(this->bus.dataPin, OUTPUT);
+        digitalWrite(this->bus.clockPin, LOW);
+        digitalWrite(this->bus.dataPin, LOW);
+        return;
+      }
+
+      this->bus.spi->begin();
+
+      // Other strips on the bus need their settings back.
+      spiOutputOwner()[this->bus.index()] = NULL;
+    }
+
+    // Buffer to encode the next frame into.
+    inline uint8_t* buffer() {
+      return this->buffers[this->back];
+    }
+
+    inline void send() {
+      if (this->bus.isSoftware()) {
+        if (this->halfTicks) {
+          this->shiftOut<true>();
+        } else {
+          this->shiftOut<false>();
+        }
+        return;
+      }
+
+      // Wait for any transfer still in progress on the bus.
+      this->waitForSend();
+      this->configure();
+
+      if (!this->async) {
+        this->bus.spi->transfer(this->buffer(), NULL, this->size, NULL);
+        return;
+      }
+
+      wiring_spi_dma_transfercomplete_callback_t done = spiOutputDone<0>;
+#if Wiring_SPI1
+      if (this->bus.index() == 1)
+        done = spiOutputDone<1>;
+#endif
+
+      spiOutputBusy()[this->bus.index()] = true;
+      this->bus.spi->transfer(this->buffer(), NULL, this->size, done);
+      this->back ^= 1;
+    }
+
+    // Fence for async mode. True until the last transfer on the bus has
+    // completed.
+    inline bool isSending() {
+      return !this->bus.isSoftware() && spiOutputBusy()[this->bus.index()];
+    }
+
+    inline void waitForSend() {
+      while (this->isSending()) {
+        delayMicroseconds(1);
+      }
+    }
+
+  private:
+    SpiOutput(const SpiOutput&);
+    SpiOutput& operator=(const SpiOutput&);
+
+    // Apply this strip's settings, unless the bus already has them.
+    inline void configure() {
+      SpiOutput*& owner = spiOutputOwner()[this->bus.index()];
+      if (owner == this)
+        return;
+
+      this->bus.spi->setBitOrder(MSBFIRST);
+      this->bus.spi->setDataMode(SPI_MODE0);
+      // Always set, so a default speed strip doesn't keep the clock of a
+      // strip that used the bus before it.
+      this->bus.spi->setClockSpeed(this->bus.clockSpeed ?
+                                   this->bus.clockSpeed :
+                                   spiDefaultClock(this->bus.index()));
+
+      owner = this;
+    }
+
+    template<bool TIMED>
+    inline void shiftOut() {
+      const uint8_t* data = this->buffer();
+
+      for (int i = 0; i < this->size; i++) {
+        uint8_t value = data[i];
+        this->shiftBit<TIMED>(value & 0x80);
+        this->shiftBit<TIMED>(value & 0x40);
+        this->shiftBit<TIMED>(value & 0x20);
+        this->shiftBit<TIMED>(value & 0x10);
+        this->shiftBit<TIMED>(value & 0x08);
+        this->shiftBit<TIMED>(value & 0x04);
+        this->shiftBit<TIMED>(value & 0x02);
+        this->shiftBit<TIMED>(value & 0x01);
+      }
+    }
+
+    template<bool TIMED>
+    inline void shiftBit(bool one) {
+      if (one) {
+        setPortPins(this->dataPort, this->dataMask);
+      } else {
+        clearPortPins(this->dataPort, this->dataMask);
+      }
+
+      if (TIMED)
+        this->waitTicks();
+      setPortPins(this->clockPort, this->clockMask);
+
+      if (TIMED)
+        this->waitTicks();
+      clearPortPins(this->clockPort, this->clockMask);
+    }
+
+    inline void waitTicks() {
+      uint32_t start = System.ticks();
+      while (System.ticks() - start < this->halfTicks) {}
+    }
+
+    int size;
+    bool async;
+    int back;
+    uint8_t* buffers[2];
+    uint8_t* allocated;
+    SpiBus bus;
+
+    // Software SPI pins.
+    GPIO_TypeDef* clockPort;
+    GPIO_TypeDef* dataPort;
+    uint16_t clockMask;
+    uint16_t dataMask;
+    uint32_t halfTicks;
+};
+
+#endif
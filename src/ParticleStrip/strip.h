@@ -21,56 +21,637 @@
 #define STRIP_H
 
 #include "color.h"
+#include "output.h"
+#include "palette.h"
 
 //
 // This class is an abstract interface for controlling a color strip. To use
-// instantiate a hardware specific implementation, and call "drawPixel" once per
-// pixel (extra calls are ignored). Call "finishDraw" to finalize an update to
-// the strip.
+// instantiate a hardware specific implementation, and draw into the strip's
+// frame buffer. Call "finishDraw" to send the frame buffer to the hardware.
 //
-// Actual LEDs may be updated during drawPixel, or during finishDraw, depending
-// on hardware.
+// Pixels can be drawn in order with "drawPixel" or "drawSpan" (extra pixels
+// are ignored), or at any position with "setPixel". "fillRange" and
+// "copyRange" update runs of pixels in place, so sparse animations only touch
+// the pixels that change. "drawFrame" draws and finishes a whole frame in one
+// call.
 //
+// Hardware implementations override "show" to encode the frame buffer and
+// send it to the LEDs in bulk, through "output" (see output.h), which applies
+// the strip's brightness, gamma correction and color order.
+//
+// The strip tracks whether the frame buffer changed since it was last shown,
+// and finishDraw skips sending frames identical to the last one. Unchanged
+// frames are still resent every "refresh interval" (in ms), to recover from
+// glitches. An interval of 0 sends every frame.
+//
+// The strip also keeps a running estimate of its current draw, updated as
+// pixels change. If a power budget is set, frames that would exceed it are
+// sent at a reduced brightness (applied by the output stage as the frame is
+// encoded, not as a separate pass).
+//
+// The frame buffer can be stored in several formats (see PixelFormat), to
+// trade color resolution for RAM. Pixels are always read and written as
+// Colors; values are reduced to what the format can hold as they are stored.
+//
+// PIXEL_WIRE has no frame buffer of its own. Pixels are kept in the buffer
+// the hardware is sent from, in wire order, so a strip needs no memory beyond
+// what its driver already holds. Frames are sent exactly as drawn: brightness,
+// gamma and power limits are not applied. Only strips that send 8 bit RGB
+// triples (NeoStrip) support it, others use PIXEL_RGB888 instead.
+//
+// The frame buffer is allocated by the constructor, unless the hardware
+// implementation provides one (see FixedDotStrip in dot-strip.h). If it can't
+// be allocated, the strip has no pixels: getPixelCount() returns 0, and draws
+// are ignored.
+//
+// Each strip has a maximum frame rate. Animations (see patterns.h) never draw
+// faster than it, and drop frames instead of slowing down when the hardware
+// can't keep up.
+//
+
+#define DEFAULT_REFRESH_INTERVAL (1000)
+
+#define DEFAULT_MAX_FRAME_RATE (100)
+
+// Typical current for one fully lit channel of a pixel (WS2812, APA102).
+#define DEFAULT_CHANNEL_MILLIAMPS (20)
+
+typedef enum {
+  PIXEL_COLOR,     // 4 bytes per pixel, a Color.
+  PIXEL_RGB888,    // 3 bytes per pixel.
+  PIXEL_RGB565,    // 2 bytes per pixel, 5/6/5 bits of red/green/blue.
+  PIXEL_PALETTE8,  // 1 byte per pixel, an index into a 256 color palette.
+  PIXEL_PALETTE4,  // 4 bits per pixel, an index into the first 16 colors.
+  PIXEL_WIRE,      // 3 bytes per pixel, shared with the hardware (see below).
+} PixelFormat;
 
 class ColorStrip {
   public:
-    inline ColorStrip(int pixelCount, bool buffer=true) :
+    inline ColorStrip(int pixelCount, PixelFormat pixelFormat=PIXEL_COLOR,
+                      uint8_t* frameBuffer=NULL) :
         pixelCount(pixelCount),
         drawOffset(0),
-        pixelBuffer(NULL) {
-      if (buffer) {
-        this->pixelBuffer = (Color*)malloc(sizeof(Color) * pixelCount);
+        pixelData(NULL),
+        pixelFormat(pixelFormat),
+        palette(isPaletteFormat(pixelFormat) ? ColorPalette::shared() : NULL),
+        paletteGeneration(this->palette ? this->palette->getGeneration() : 0),
+        dirty(true),
+        refreshInterval(DEFAULT_REFRESH_INTERVAL),
+        lastShow(0),
+        frameInterval(1000000 / DEFAULT_MAX_FRAME_RATE),
+        brightness(255),
+        powerBudget(0),
+        channelMilliamps(DEFAULT_CHANNEL_MILLIAMPS),
+        levelSum(0),
+        levelsStale(false),
+        ownsPixelData(false) {
+      // Zeroed memory is BLACK, in every format. PIXEL_WIRE storage is
+      // provided by the hardware implementation (see useWireBuffer).
+      if (pixelFormat == PIXEL_WIRE)
+        return;
+
+      size_t size = frameBufferSize(pixelFormat, pixelCount);
+      if (frameBuffer) {
+        memset(frameBuffer, 0, size);
+        this->pixelData = frameBuffer;
+      } else {
+        this->pixelData = (uint8_t*)calloc(size, 1);
+        this->ownsPixelData = true;
       }
+
+      if (!this->pixelData)
+        this->pixelCount = 0;
+    }
+
+    virtual inline ~ColorStrip() {
+      if (this->ownsPixelData)
+        free(this->pixelData);
     }
 
-    virtual inline void drawPixel(Color color) {
+    static constexpr bool isPaletteFormat(PixelFormat pixelFormat) {
+      return (pixelFormat == PIXEL_PALETTE8 ||
+              pixelFormat == PIXEL_PALETTE4);
+    }
+
+    // Bytes of frame buffer needed for a number of pixels.
+    static constexpr size_t frameBufferSize(PixelFormat pixelFormat,
+                                            int pixelCount) {
+      return (pixelFormat == PIXEL_RGB888 ? pixelCount * 3 :
+              pixelFormat == PIXEL_RGB565 ? pixelCount * 2 :
+              pixelFormat == PIXEL_PALETTE8 ? pixelCount :
+              pixelFormat == PIXEL_PALETTE4 ? (pixelCount + 1) / 2 :
+              pixelFormat == PIXEL_WIRE ? 0 :
+              pixelCount * sizeof(Color));
+    }
+
+    inline void drawPixel(Color color) {
       if (this->drawOffset >= this->pixelCount) {
         return;
       }
 
-      this->pixelBuffer[this->drawOffset] = color;
+      this->setPixel(this->drawOffset, color);
       this->drawOffset++;
     }
 
-    virtual inline void finishDraw() {
+    inline void drawSpan(const Color* colors, int count) {
+      if (count > this->pixelCount - this->drawOffset) {
+        count = this->pixelCount - this->drawOffset;
+      }
+
+      if (count <= 0) {
+        return;
+      }
+
+      for (int i = 0; i < count; i++) {
+        this->setPixel(this->drawOffset + i, colors[i]);
+      }
+
+      this->drawOffset += count;
+    }
+
+    inline void drawFrame(const Color* colors, int count) {
       this->drawOffset = 0;
+      this->drawSpan(colors, count);
+      this->finishDraw();
     }
 
-    virtual inline void drawSolid(Color color) {
-      for (int i = 0; i < this->pixelCount; i++) {
-        this->drawPixel(color);
+    inline void drawSolid(Color color) {
+      this->fillRange(0, this->pixelCount, color);
+      this->finishDraw();
+    }
+
+    // Set count pixels from start to color. Pixels off the strip are ignored.
+    inline void fillRange(int start, int count, Color color) {
+      if (!this->clipRange(start, count))
+        return;
+
+      if (this->pixelFormat != PIXEL_COLOR) {
+        for (int i = start; i < start + count; i++) {
+          this->setPixel(i, color);
+        }
+        return;
       }
 
-      this->finishDraw();
+      // Whole pixels are compared and stored as words.
+      uint32_t fill = colorWord(color);
+      int changed = 0;
+
+      for (uint8_t* pixel = this->pixelData + start * sizeof(Color);
+           pixel < this->pixelData + (start + count) * sizeof(Color);
+           pixel += sizeof(Color)) {
+        uint32_t old;
+        memcpy(&old, pixel, sizeof(old));
+
+        if (old != fill) {
+          this->levelSum -= this->pixelLevel(wordColor(old));
+          memcpy(pixel, &fill, sizeof(fill));
+          changed++;
+        }
+      }
+
+      if (changed) {
+        this->levelSum += changed * this->pixelLevel(color);
+        this->dirty = true;
+      }
     }
 
+    // Copy count pixels from "from" to "to". The ranges may overlap. Pixels
+    // off the strip are ignored.
+    inline void copyRange(int to, int from, int count) {
+      if (from < 0) {
+        count += from;
+        to -= from;
+        from = 0;
+      }
+      if (to < 0) {
+        count += to;
+        from -= to;
+        to = 0;
+      }
+      if (count > this->pixelCount - (from > to ? from : to)) {
+        count = this->pixelCount - (from > to ? from : to);
+      }
+      if (count <= 0 || from == to)
+        return;
+
+      // Walk away from the overlap, like memmove.
+      int step = to > from ? -1 : 1;
+      int i = to > from ? count - 1 : 0;
+
+      if (this->pixelFormat != PIXEL_COLOR) {
+        for (int n = 0; n < count; n++, i += step) {
+          this->setPixel(to + i, this->getPixel(from + i));
+        }
+        return;
+      }
+
+      // Whole pixels are compared and stored as words.
+      const uint8_t* source = this->pixelData + from * sizeof(Color);
+      uint8_t* dest = this->pixelData + to * sizeof(Color);
+      bool changed = false;
+
+      for (int n = 0; n < count; n++, i += step) {
+        uint32_t old, word;
+        memcpy(&old, dest + i * sizeof(Color), sizeof(old));
+        memcpy(&word, source + i * sizeof(Color), sizeof(word));
+
+        if (old != word) {
+          this->levelSum += (this->pixelLevel(wordColor(word)) -
+                             this->pixelLevel(wordColor(old)));
+          memcpy(dest + i * sizeof(Color), &word, sizeof(word));
+          changed = true;
+        }
+      }
+
+      if (changed)
+        this->dirty = true;
+    }
+
+    // Store count pixels from "colors", starting at pixel "start", as
+    // setPixel() would. Pixels off the strip are ignored.
+    inline void setPixels(int start, const Color* colors, int count) {
+      int first = start;
+      if (!this->clipRange(start, count))
+        return;
+      colors += start - first;
+
+      if (this->pixelFormat != PIXEL_COLOR) {
+        for (int i = 0; i < count; i++) {
+          this->setPixel(start + i, colors[i]);
+        }
+        return;
+      }
+
+      // Whole pixels are compared and stored as words.
+      uint8_t* pixel = this->pixelData + start * sizeof(Color);
+      bool changed = false;
+
+      for (int i = 0; i < count; i++, pixel += sizeof(Color)) {
+        uint32_t old;
+        memcpy(&old, pixel, sizeof(old));
+        uint32_t word = colorWord(colors[i]);
+
+        if (old != word) {
+          this->levelSum += (this->pixelLevel(colors[i]) -
+                             this->pixelLevel(wordColor(old)));
+          memcpy(pixel, &word, sizeof(word));
+          changed = true;
+        }
+      }
+
+      if (changed)
+        this->dirty = true;
+    }
+
+    inline void setPixel(int index, Color color) {
+      Color old = this->getPixel(index);
+      Color stored = this->storePixel(index, color);
+
+      if (old != stored) {
+        this->levelSum += this->pixelLevel(stored) - this->pixelLevel(old);
+        this->dirty = true;
+      }
+    }
+
+    inline Color getPixel(int index) {
+      switch (this->pixelFormat) {
+        case PIXEL_RGB888: {
+          const uint8_t* rgb = this->pixelData + index * 3;
+          return Color{0x00, rgb[0], rgb[1], rgb[2]};
+        }
+        case PIXEL_RGB565: {
+          uint16_t packed;
+          memcpy(&packed, this->pixelData + index * 2, sizeof(packed));
+          return rgb565ToColor(packed);
+        }
+        case PIXEL_PALETTE8:
+          return this->palette->get(this->pixelData[index]);
+        case PIXEL_PALETTE4:
+          return this->palette->get(
+              (this->pixelData[index / 2] >> (index % 2 * 4)) & 0x0F);
+        case PIXEL_WIRE:
+          return this->output.read(this->pixelData + index * 3);
+        case PIXEL_COLOR:
+          break;
+      }
+
+      Color color;
+      memcpy(&color, this->pixelData + index * sizeof(Color), sizeof(color));
+      return color;
+    }
+
+    // Implementations override this through finishDrawWith(), calling their
+    // own show() directly (see BasicPattern in patterns.h).
+    virtual inline void finishDraw() {
+      this->finishDrawWith([this] { this->show(); });
+    }
+
+    // Global brightness, applied as frames are sent. 255 is full brightness.
+    inline void setBrightness(uint8_t brightness) {
+      this->brightness = brightness;
+      this->output.setBrightness(brightness);
+      this->markDirty();
+    }
+
+    inline uint8_t getBrightness() { return this->brightness; }
+
+    // Gamma correct colors as they are sent. Off by default.
+    inline void setGamma(bool gamma) {
+      this->output.setGamma(gamma);
+      this->levelsStale = true;
+      this->markDirty();
+    }
+
+    // Limit estimated current draw to budget milliamps (0 for no limit).
+    // channelMilliamps is the draw of one fully lit color channel.
+    inline void setPowerBudget(int budget,
+                               int channelMilliamps=DEFAULT_CHANNEL_MILLIAMPS) {
+      this->powerBudget = budget;
+      this->channelMilliamps = channelMilliamps;
+      this->output.setBrightness(this->brightness);
+      this->markDirty();
+    }
+
+    // Estimated current draw of the frame buffer, at the brightness it will
+    // be (or was last) sent at.
+    inline int getEstimatedMilliamps() {
+      return this->estimateMilliamps(this->output.scale());
+    }
+
+    // Override the color order, for strips wired differently from the usual
+    // for their hardware type.
+    inline void setColorOrder(ColorOrder order) {
+      this->setWireOrder(order);
+      this->markDirty();
+    }
+
+    inline void setRefreshInterval(unsigned long refreshInterval) {
+      this->refreshInterval = refreshInterval;
+    }
+
+    // Frames per second animations may draw at (0 for no limit).
+    inline void setMaxFrameRate(int frameRate) {
+      this->frameInterval = frameRate > 0 ? 1000000 / frameRate : 0;
+    }
+
+    // Minimum time between animation frames, in us.
+    inline unsigned long getFrameInterval() { return this->frameInterval; }
+
     int getPixelCount() { return this->pixelCount; }
-    Color* getPixelBuffer() { return this->pixelBuffer; }
+
+    inline PixelFormat getPixelFormat() { return this->pixelFormat; }
+
+    // Palette for the PIXEL_PALETTE formats. Palette strips share
+    // ColorPalette::shared() unless given their own, or given NULL.
+    inline void setPalette(ColorPalette* palette) {
+      if (!palette && isPaletteFormat(this->pixelFormat))
+        palette = ColorPalette::shared();
+
+      this->palette = palette;
+      this->paletteGeneration = palette ? palette->getGeneration() : 0;
+      this->levelsStale = true;
+      this->markDirty();
+    }
+
+    // Direct access to the frame buffer, in PIXEL_COLOR format only (NULL
+    // otherwise). Since writes through the pointer can't be tracked, the next
+    // frame is always sent, and the power estimate is recounted. To write
+    // whole runs of pixels without that, use setPixels().
+    Color* getPixelBuffer() {
+      if (this->pixelFormat != PIXEL_COLOR)
+        return NULL;
+
+      this->dirty = true;
+      this->levelsStale = true;
+      return (Color*)this->pixelData;
+    }
+
+    // The frame buffer, for reading only. NULL unless PIXEL_COLOR.
+    const Color* readPixelBuffer() {
+      if (this->pixelFormat != PIXEL_COLOR)
+        return NULL;
+
+      return (const Color*)this->pixelData;
+    }
 
   protected:
+    // Send the frame buffer to the hardware.
+    virtual inline void show() {}
+
+    // The steps of finishDraw(), sending the frame with a call to show().
+    // Implementations pass one naming their own show(), so final strip types
+    // skip the vtable, eg: [this] { this->DotStrip::show(); }
+    template<typename ShowT>
+    inline void finishDrawWith(ShowT show) {
+      unsigned long now = millis();
+      if (this->startShow(now)) {
+        show();
+        this->endShow(now);
+      }
+    }
+
+    // First half of finishDraw(). Returns true if the frame should be sent
+    // now, after applying any power limit.
+    inline bool startShow(unsigned long now) {
+      this->drawOffset = 0;
+
+      // Palette entries may have changed under the frame buffer.
+      if (this->palette &&
+          this->palette->getGeneration() != this->paletteGeneration) {
+        this->paletteGeneration = this->palette->getGeneration();
+        this->dirty = true;
+        this->levelsStale = true;
+      }
+
+      if (!this->dirty &&
+          this->refreshInterval &&
+          (now - this->lastShow) < this->refreshInterval) {
+        return false;
+      }
+
+      this->limitPower();
+      return true;
+    }
+
+    // Second half of finishDraw(), once the frame is sent.
+    inline void endShow(unsigned long now) {
+      this->dirty = false;
+      this->lastShow = now;
+    }
+
+    // Force the next frame to be sent, after an output setting changes.
+    inline void markDirty() {
+      this->dirty = true;
+    }
+
+    // Keep PIXEL_WIRE pixels in a hardware buffer of pixelCount * 3 bytes,
+    // instead of a frame buffer. Called from the hardware constructor.
+    inline void useWireBuffer(uint8_t* wire) {
+      this->pixelData = wire;
+      this->levelsStale = true;
+
+      if (!wire) {
+        this->pixelCount = 0;
+        return;
+      }
+
+      memset(wire, 0, this->pixelCount * 3);
+    }
+
+    // Set the wire order. PIXEL_WIRE pixels are stored in wire order, so are
+    // moved to match.
+    inline void setWireOrder(ColorOrder order) {
+      if (this->pixelFormat != PIXEL_WIRE || !this->pixelData) {
+        this->output.setOrder(order);
+        return;
+      }
+
+      ColorOutput reordered;
+      reordered.setOrder(order);
+
+      for (uint8_t* wire = this->pixelData;
+           wire < this->pixelData + this->pixelCount * 3;
+           wire += 3) {
+        Color color = this->output.read(wire);
+        reordered.write(wire, color.red, color.green, color.blue);
+      }
+
+      this->output.setOrder(order);
+    }
+
     int pixelCount;
     int drawOffset;
-    Color* pixelBuffer;
+    uint8_t* pixelData;
+    PixelFormat pixelFormat;
+    ColorPalette* palette;
+    uint32_t paletteGeneration;
+    ColorOutput output;
+
+  private:
+    ColorStrip(const ColorStrip&);
+    ColorStrip& operator=(const ColorStrip&);
+
+    // A whole pixel as one word, for single compare and store.
+    static inline uint32_t colorWord(Color color) {
+      uint32_t word;
+      memcpy(&word, &color, sizeof(word));
+      return word;
+    }
+
+    static inline Color wordColor(uint32_t word) {
+      Color color;
+      memcpy(&color, &word, sizeof(color));
+      return color;
+    }
+
+    // Write a pixel in the frame buffer format, and return the color as
+    // stored.
+    inline Color storePixel(int index, Color color) {
+      switch (this->pixelFormat) {
+        case PIXEL_RGB888: {
+          uint8_t* rgb = this->pixelData + index * 3;
+          rgb[0] = color.red;
+          rgb[1] = color.green;
+          rgb[2] = color.blue;
+          color.special = 0;
+          return color;
+        }
+        case PIXEL_RGB565: {
+          uint16_t packed = colorToRgb565(color);
+          memcpy(this->pixelData + index * 2, &packed, sizeof(packed));
+          return rgb565ToColor(packed);
+        }
+        case PIXEL_PALETTE8: {
+          uint8_t entry = this->palette->index(color);
+          this->pixelData[index] = entry;
+          return this->palette->get(entry);
+        }
+        case PIXEL_PALETTE4: {
+          uint8_t entry = this->palette->index(color, 16);
+          uint8_t& pair = this->pixelData[index / 2];
+          int shift = index % 2 * 4;
+          pair = (pair & ~(0x0F << shift)) | (entry << shift);
+          return this->palette->get(entry);
+        }
+        case PIXEL_WIRE:
+          this->output.write(this->pixelData + index * 3,
+                             color.red, color.green, color.blue);
+          color.special = 0;
+          return color;
+        case PIXEL_COLOR:
+          break;
+      }
+
+      memcpy(this->pixelData + index * sizeof(Color), &color, sizeof(color));
+      return color;
+    }
+
+    // Clip a range of pixels to the strip. Returns false if nothing is left.
+    inline bool clipRange(int& start, int& count) {
+      if (start < 0) {
+        count += start;
+        start = 0;
+      }
+      if (count > this->pixelCount - start) {
+        count = this->pixelCount - start;
+      }
+      return count > 0;
+    }
+
+    // Sum of a pixel's channel levels (after gamma, before brightness), in
+    // 12 bit units.
+    inline uint32_t pixelLevel(Color color) {
+      return ((this->output.linear(color.red) >> 4) +
+              (this->output.linear(color.green) >> 4) +
+              (this->output.linear(color.blue) >> 4));
+    }
+
+    // Milliamps drawn by the frame buffer at a 0 - 256 brightness scale.
+    inline int estimateMilliamps(uint32_t scale) {
+      if (this->levelsStale) {
+        // Only after raw buffer access, or a gamma change.
+        this->levelSum = 0;
+        for (int i = 0; i < this->pixelCount; i++) {
+          this->levelSum += this->pixelLevel(this->getPixel(i));
+        }
+        this->levelsStale = false;
+      }
+
+      return ((uint64_t)this->levelSum * scale * this->channelMilliamps /
+              (4095 * 256));
+    }
+
+    // Reduce the output brightness for this frame, if needed to stay in the
+    // power budget.
+    inline void limitPower() {
+      if (!this->powerBudget || this->pixelFormat == PIXEL_WIRE)
+        return;
+
+      uint8_t limited = this->brightness;
+      int draw = this->estimateMilliamps(this->brightness +
+                                         (this->brightness >> 7));
+      if (draw > this->powerBudget) {
+        limited = (uint32_t)this->brightness * this->powerBudget / draw;
+      }
+
+      if (limited != this->output.getBrightness()) {
+        this->output.setBrightness(limited);
+      }
+    }
+
+    bool dirty;
+    unsigned long refreshInterval;
+    unsigned long lastShow;
+    unsigned long frameInterval;
+
+    uint8_t brightness;
+    int powerBudget;
+    int channelMilliamps;
+    uint32_t levelSum;
+    bool levelsStale;
+
+    // False if the frame buffer was provided by the implementation.
+    bool ownsPixelData;
 };
 
 #endif
@@ -25,90 +25,317 @@
 #include "color.h"
 #include "patterns.h"
 
+// Text buffer sizes that always fit, including the terminator.
+#define COLOR_TEXT_SIZE (15)     // "RANDOM_PRIMARY"
+#define PATTERN_TEXT_SIZE (52)   // "ALTERNATE,RANDOM_PRIMARY,RANDOM_PRIMARY,-2147483648"
+
+//
+// Name tables.
 //
-// Convert Colors to/from Strings.
+// The tables are constexpr, so they live in flash and need no static
+// initialization. Names are looked up through a perfect hash: the hash seed is
+// searched for at compile time so that every name lands in its own slot, and
+// the slot to entry tables are built from it. Adding a name to a table only
+// needs a bigger *_BITS if the search fails to compile.
 //
 
-static const struct { String name; Color color; } COLOR_NAME_MAP[] = {
-  "BLACK", BLACK,
-  "WHITE", WHITE,
-  "RED", RED,
-  "GREEN", GREEN,
-  "BLUE", BLUE,
-  "YELLOW", YELLOW,
-  "LIGHT_BLUE", LIGHT_BLUE,
-  "PURPLE", PURPLE,
-  "RANDOM", RANDOM,
-  "RANDOM_PRIMARY", RANDOM_PRIMARY,
+struct ColorName {
+  const char* name;
+  Color color;
+};
+
+static constexpr ColorName COLOR_NAME_MAP[] = {
+  { "BLACK", BLACK },
+  { "WHITE", WHITE },
+  { "RED", RED },
+  { "GREEN", GREEN },
+  { "BLUE", BLUE },
+  { "YELLOW", YELLOW },
+  { "LIGHT_BLUE", LIGHT_BLUE },
+  { "PURPLE", PURPLE },
+  { "RANDOM", RANDOM },
+  { "RANDOM_PRIMARY", RANDOM_PRIMARY },
 };
 #define COLOR_NAME_MAP_SIZE (sizeof(COLOR_NAME_MAP) / sizeof(COLOR_NAME_MAP[0]))
 
-static const String PATTERN_NAMES[] = {
+static constexpr const char* PATTERN_NAMES[] = {
   "SOLID", "PULSE", "CYLON", "ALTERNATE", "FLICKER", "LAVA", "TEST"
 };
 
+// Hash table sizes, as a power of 2.
+#define COLOR_NAME_BITS (4)
+#define PATTERN_NAME_BITS (3)
+
+// FNV-1a, starting from seed.
+constexpr uint32_t _nameHash(const char* text, size_t length, uint32_t seed) {
+  return length ?
+      _nameHash(text + 1, length - 1, (seed ^ (uint8_t)*text) * 16777619u) :
+      seed;
+}
+
+constexpr size_t _nameLength(const char* name) {
+  return *name ? 1 + _nameLength(name + 1) : 0;
+}
+
+constexpr const char* _entryName(const char* name) { return name; }
+constexpr const char* _entryName(const ColorName& entry) { return entry.name; }
+
+constexpr unsigned _nameSlot(const char* name, uint32_t seed, int bits) {
+  return _nameHash(name, _nameLength(name), seed) >> (32 - bits);
+}
+
+// Do entries i and j onwards all hash to different slots.
+template<typename T, size_t N>
+constexpr bool _slotsDistinct(const T (&table)[N], uint32_t seed, int bits,
+                              size_t i=0, size_t j=1) {
+  return i + 1 >= N ? true :
+         j >= N ? _slotsDistinct(table, seed, bits, i + 1, i + 2) :
+         (_nameSlot(_entryName(table[i]), seed, bits) !=
+          _nameSlot(_entryName(table[j]), seed, bits) &&
+          _slotsDistinct(table, seed, bits, i, j + 1));
+}
+
+// First seed from seed that gives a perfect hash, or 0 if none is found.
+template<typename T, size_t N>
+constexpr uint32_t _findSeed(const T (&table)[N], int bits,
+                             uint32_t seed=2166136261u, int tries=256) {
+  return !tries ? 0 :
+         _slotsDistinct(table, seed, bits) ? seed :
+         _findSeed(table, bits, seed + 1, tries - 1);
+}
+
+// Index of the entry in a slot, or -1 if it's empty.
+template<typename T, size_t N>
+constexpr int _slotEntry(const T (&table)[N], uint32_t seed, int bits,
+                         unsigned slot, size_t i=0) {
+  return i >= N ? -1 :
+         _nameSlot(_entryName(table[i]), seed, bits) == slot ? i :
+         _slotEntry(table, seed, bits, slot, i + 1);
+}
+
+static constexpr uint32_t COLOR_NAME_SEED =
+    _findSeed(COLOR_NAME_MAP, COLOR_NAME_BITS);
+static_assert(COLOR_NAME_SEED, "No perfect hash for COLOR_NAME_MAP.");
+
+static constexpr uint32_t PATTERN_NAME_SEED =
+    _findSeed(PATTERN_NAMES, PATTERN_NAME_BITS);
+static_assert(PATTERN_NAME_SEED, "No perfect hash for PATTERN_NAMES.");
+
+#define _COLOR_SLOT(slot) \
+    _slotEntry(COLOR_NAME_MAP, COLOR_NAME_SEED, COLOR_NAME_BITS, slot)
+#define _PATTERN_SLOT(slot) \
+    _slotEntry(PATTERN_NAMES, PATTERN_NAME_SEED, PATTERN_NAME_BITS, slot)
+
+static constexpr int8_t COLOR_NAME_SLOTS[1 << COLOR_NAME_BITS] = {
+  _COLOR_SLOT(0), _COLOR_SLOT(1), _COLOR_SLOT(2), _COLOR_SLOT(3),
+  _COLOR_SLOT(4), _COLOR_SLOT(5), _COLOR_SLOT(6), _COLOR_SLOT(7),
+  _COLOR_SLOT(8), _COLOR_SLOT(9), _COLOR_SLOT(10), _COLOR_SLOT(11),
+  _COLOR_SLOT(12), _COLOR_SLOT(13), _COLOR_SLOT(14), _COLOR_SLOT(15),
+};
+
+static constexpr int8_t PATTERN_NAME_SLOTS[1 << PATTERN_NAME_BITS] = {
+  _PATTERN_SLOT(0), _PATTERN_SLOT(1), _PATTERN_SLOT(2), _PATTERN_SLOT(3),
+  _PATTERN_SLOT(4), _PATTERN_SLOT(5), _PATTERN_SLOT(6), _PATTERN_SLOT(7),
+};
+
+#undef _COLOR_SLOT
+#undef _PATTERN_SLOT
+
+static_assert(COLOR_NAME_BITS == 4 && PATTERN_NAME_BITS == 3,
+              "Resize the slot tables to match.");
+static_assert(sizeof(PATTERN_NAMES) / sizeof(PATTERN_NAMES[0]) == PATTERN_COUNT,
+              "A name is needed for every PatternType.");
+
+// Does text of length exactly match a name.
+inline bool _textMatches(const char* text, size_t length, const char* name) {
+  return strncmp(text, name, length) == 0 && name[length] == '\0';
+}
+
+// Index of a name in a table, through its slot table. -1 if not found.
+template<typename T, size_t N, size_t S>
+inline int _lookupName(const T (&table)[N], const int8_t (&slots)[S],
+                       uint32_t seed, int bits,
+                       const char* text, size_t length) {
+  int entry = slots[_nameHash(text, length, seed) >> (32 - bits)];
+  if (entry < 0 || !_textMatches(text, length, _entryName(table[entry])))
+    return -1;
+
+  return entry;
+}
+
+//
+// User color names.
+//
+// An extension point for application specific names. They are searched after
+// the built in names, so can't replace them. Each name must outlive its
+// registration (a string literal is ideal), and be no longer than the built
+// in names (COLOR_TEXT_SIZE - 1), so formatted colors always fit.
+//
+
+#define USER_COLOR_NAMES_MAX (8)
+
+struct _UserColorNames {
+  ColorName entries[USER_COLOR_NAMES_MAX];
+  int count;
+};
+
+// Shared by every translation unit.
+inline _UserColorNames& _userColorNames() {
+  static _UserColorNames names;
+  return names;
+}
+
+// Returns false if the name is taken or too long, or there is no room left.
+inline bool registerColorName(const char* name, Color color) {
+  _UserColorNames& names = _userColorNames();
+  size_t length = strlen(name);
+
+  if (length == 0 || length > COLOR_TEXT_SIZE - 1 ||
+      names.count >= USER_COLOR_NAMES_MAX ||
+      _lookupName(COLOR_NAME_MAP, COLOR_NAME_SLOTS, COLOR_NAME_SEED,
+                  COLOR_NAME_BITS, name, length) >= 0)
+    return false;
+
+  for (int i = 0; i < names.count; i++) {
+    if (_textMatches(name, length, names.entries[i].name))
+      return false;
+  }
+
+  names.entries[names.count].name = name;
+  names.entries[names.count].color = color;
+  names.count++;
+  return true;
+}
+
+inline void clearColorNames() {
+  _userColorNames().count = 0;
+}
+
 //
 // This contains helpers for converting colors and patterns into simple
 // text strings.
 //
+// The format* and parse* functions work on caller provided buffers, and never
+// allocate. Like snprintf, format* always terminates the buffer (truncating if
+// needed) and returns the full length of the text. The String versions are
+// wrappers around them.
+//
+
+// Append text to a buffer of size bytes, of which used are already filled.
+inline void _appendText(char* buffer, size_t size, size_t& used,
+                        const char* text, size_t length) {
+  if (used + 1 < size) {
+    size_t room = size - used - 1;
+    memcpy(buffer + used, text, length < room ? length : room);
+  }
+
+  used += length;
+
+  if (size) {
+    buffer[used < size ? used : size - 1] = '\0';
+  }
+}
 
-// Helper to convert a byte to a two digit HEX string.
-inline String _colorToStringHelper(uint8_t b) {
-  String result(b, HEX);
-  return result.length() == 1 ? "0" + result : result;
+inline int _hexDigit(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
 }
 
-// Returns string that can be turned back into a color.
+// Writes text that can be turned back into a color.
 // For primaries, can be a well known name (ie: 'RED').
 // For other colors a hex value (ie: 0xFFFFFFFF).
-inline String colorToString(Color color) {
-  // Try to look up well known color names.
-  for (int i = 0; i < COLOR_NAME_MAP_SIZE; i++) {
+inline size_t formatColor(Color color, char* buffer, size_t size) {
+  size_t used = 0;
+
+  // Try to look up well known color names, then user names.
+  for (size_t i = 0; i < COLOR_NAME_MAP_SIZE; i++) {
     if (color == COLOR_NAME_MAP[i].color) {
-      return COLOR_NAME_MAP[i].name;
+      const char* name = COLOR_NAME_MAP[i].name;
+      _appendText(buffer, size, used, name, strlen(name));
+      return used;
+    }
+  }
+
+  const _UserColorNames& names = _userColorNames();
+  for (int i = 0; i < names.count; i++) {
+    if (color == names.entries[i].color) {
+      const char* name = names.entries[i].name;
+      _appendText(buffer, size, used, name, strlen(name));
+      return used;
     }
   }
 
-  // This is horrible, but works.
-  String result = (
-    "0x" +
-    _colorToStringHelper(color.special) +
-    _colorToStringHelper(color.red) +
-    _colorToStringHelper(color.green) +
-    _colorToStringHelper(color.blue)
-  );
+  static const char DIGITS[] = "0123456789ABCDEF";
+  uint8_t bytes[] = { color.special, color.red, color.green, color.blue };
 
-  result.toUpperCase();
-  return result;
+  char hex[10] = { '0', 'x' };
+  for (int i = 0; i < 4; i++) {
+    hex[2 + i * 2] = DIGITS[bytes[i] >> 4];
+    hex[3 + i * 2] = DIGITS[bytes[i] & 0xF];
+  }
+
+  _appendText(buffer, size, used, hex, sizeof(hex));
+  return used;
 }
 
-// Accepts output of above. Returns BLACK on failure.
-inline Color stringToColor(String color) {
+// Accepts length bytes of text in the output of formatColor. Returns false
+// if it's not a valid color.
+inline bool parseColor(const char* text, size_t length, Color* color) {
+  // Try to look up well known color names, then user names.
+  int entry = _lookupName(COLOR_NAME_MAP, COLOR_NAME_SLOTS, COLOR_NAME_SEED,
+                          COLOR_NAME_BITS, text, length);
+  if (entry >= 0) {
+    *color = COLOR_NAME_MAP[entry].color;
+    return true;
+  }
 
-  // Try to look up well known color names.
-  for (int i = 0; i < COLOR_NAME_MAP_SIZE; i++) {
-    if (color == COLOR_NAME_MAP[i].name) {
-      return COLOR_NAME_MAP[i].color;
+  const _UserColorNames& names = _userColorNames();
+  for (int i = 0; i < names.count; i++) {
+    if (_textMatches(text, length, names.entries[i].name)) {
+      *color = names.entries[i].color;
+      return true;
     }
   }
 
   // Otherwise, it's expected to be a HEX string of format "0xFFFFFFFF",
   // case insensitive.
+  if (length != 10 || text[0] != '0' || (text[1] != 'x' && text[1] != 'X'))
+    return false;
 
-  String prefix = color.substring(0, 2);
-  prefix.toUpperCase();
+  // Read each byte in the expected order.
+  uint8_t bytes[4];
+  for (int i = 0; i < 4; i++) {
+    int high = _hexDigit(text[2 + i * 2]);
+    int low = _hexDigit(text[3 + i * 2]);
+    if (high < 0 || low < 0)
+      return false;
+
+    bytes[i] = high << 4 | low;
+  }
 
-  // If it's a bad string, default to BLACK.
-  if (prefix != "0X" || color.length() != 10)
-    return BLACK;
+  color->special = bytes[0];
+  color->red = bytes[1];
+  color->green = bytes[2];
+  color->blue = bytes[3];
+  return true;
+}
 
-  Color result;
+inline String colorToString(Color color) {
+  char buffer[COLOR_TEXT_SIZE];
+  formatColor(color, buffer, sizeof(buffer));
+  return String(buffer);
+}
 
-  // Read each byte in the expected order.
-  result.special = strtol(color.substring(2, 4).c_str(), NULL, 16);
-  result.red = strtol(color.substring(4, 6).c_str(), NULL, 16);
-  result.green = strtol(color.substring(6, 8).c_str(), NULL, 16);
-  result.blue = strtol(color.substring(8, 10).c_str(), NULL, 16);
+// Accepts output of above. Returns BLACK on failure.
+inline Color stringToColor(const String& color) {
+  Color result;
+  if (!parseColor(color.c_str(), color.length(), &result))
+    return BLACK;
 
   return result;
 }
@@ -117,70 +344,111 @@ inline Color stringToColor(String color) {
 // Convert Patterns to/from Strings.
 //
 
-inline String patternTypeToString(PatternType pattern) {
-  return PATTERN_NAMES[pattern]  ;
+inline const char* patternTypeName(PatternType pattern) {
+  if (pattern < 0 || pattern >= PATTERN_COUNT)
+    return PATTERN_NAMES[SOLID];
+
+  return PATTERN_NAMES[pattern];
 }
 
-inline PatternType stringToPatternType(String patternText) {
-  // Search for the pattern.
-  int patternOffset;
-  for (patternOffset = 0; patternOffset < PATTERN_COUNT; patternOffset++) {
-    if (patternText == PATTERN_NAMES[patternOffset]) {
-      break;
-    }
-  }
-  if (patternOffset == PATTERN_COUNT)
-    return SOLID;
+// Returns SOLID for unknown patterns.
+inline PatternType parsePatternType(const char* text, size_t length) {
+  int entry = _lookupName(PATTERN_NAMES, PATTERN_NAME_SLOTS, PATTERN_NAME_SEED,
+                          PATTERN_NAME_BITS, text, length);
 
-  return (PatternType)patternOffset;
+  return entry < 0 ? SOLID : (PatternType)entry;
+}
+
+inline String patternTypeToString(PatternType pattern) {
+  return String(patternTypeName(pattern));
+}
+
+inline PatternType stringToPatternType(const String& patternText) {
+  return parsePatternType(patternText.c_str(), patternText.length());
 }
 
 // Get/Set the pattern based on a string of the form:
 //   <PATTERN>,<COLOR>,<COLOR>,<SPEED>
 //   Eg: "CYLON,BLUE,0x00050505,1000"
-inline String patternToString(PatternDescription pattern) {
+inline size_t formatPattern(const PatternDescription& pattern,
+                            char* buffer, size_t size) {
+  size_t used = 0;
 
   // <PATTERN>,0xFFFFFF,0xFFFFFF,55
-  return (patternTypeToString(pattern.pattern) + ',' +
-          colorToString(pattern.a) + ',' +
-          colorToString(pattern.b) + ',' +
-          pattern.speed);
-}
-
-inline PatternDescription stringToPattern(String value) {
-  PatternDescription newPattern;
-
-  // These are the
-  int wordBegin = 0;
-  int wordEnd = value.indexOf(',');
-  if (wordEnd <= 0)
-    return PatternDescription();
+  const char* name = patternTypeName(pattern.pattern);
+  _appendText(buffer, size, used, name, strlen(name));
+
+  Color colors[] = { pattern.a, pattern.b };
+  for (int i = 0; i < 2; i++) {
+    char color[COLOR_TEXT_SIZE];
+    _appendText(buffer, size, used, ",", 1);
+    _appendText(buffer, size, used,
+                color, formatColor(colors[i], color, sizeof(color)));
+  }
 
-  newPattern.pattern = stringToPatternType(value.substring(wordBegin, wordEnd));
+  // Digits are written backwards from the end.
+  char speed[12];
+  char* digit = speed + sizeof(speed);
+  unsigned long magnitude = pattern.speed < 0 ?
+      0UL - (unsigned long)pattern.speed : (unsigned long)pattern.speed;
+  do {
+    *--digit = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude);
+  if (pattern.speed < 0)
+    *--digit = '-';
+  *--digit = ',';
+
+  _appendText(buffer, size, used, digit, speed + sizeof(speed) - digit);
+  return used;
+}
 
-  wordBegin = wordEnd + 1;
-  wordEnd = value.indexOf(',', wordBegin);
-  if (wordEnd <= 0)
-    return PatternDescription();
+// Accepts the output of formatPattern, terminated. Returns false (and sets
+// pattern to the default) if the text is malformed. Unknown patterns are
+// read as SOLID, and unknown colors as BLACK.
+inline bool parsePattern(const char* text, PatternDescription* pattern) {
+  *pattern = PatternDescription();
+
+  // Find the three separators.
+  const char* comma[3];
+  const char* cursor = text;
+  for (int i = 0; i < 3; i++) {
+    comma[i] = strchr(cursor, ',');
+    if (!comma[i] || comma[i] == text)
+      return false;
+
+    cursor = comma[i] + 1;
+  }
 
-  newPattern.a = stringToColor(value.substring(wordBegin, wordEnd));
+  PatternDescription result;
+  result.pattern = parsePatternType(text, comma[0] - text);
 
-  wordBegin = wordEnd + 1;
-  wordEnd = value.indexOf(',', wordBegin);
-  if (wordEnd <= 0)
-    return PatternDescription();
+  const char* colorText = comma[0] + 1;
+  if (!parseColor(colorText, comma[1] - colorText, &result.a))
+    result.a = BLACK;
 
-  newPattern.a = stringToColor(value.substring(wordBegin, wordEnd));
+  colorText = comma[1] + 1;
+  if (!parseColor(colorText, comma[2] - colorText, &result.b))
+    result.b = BLACK;
 
-  wordBegin = wordEnd + 1;
+  result.speed = strtol(comma[2] + 1, NULL, 10);
+  if (result.speed < 0)
+    return false;
 
-  String speedText = value.substring(wordBegin);
-  newPattern.speed = strtol(speedText.c_str(), NULL, 10);
+  *pattern = result;
+  return true;
+}
 
-  if (newPattern.speed < 0)
-    return PatternDescription();
+inline String patternToString(const PatternDescription& pattern) {
+  char buffer[PATTERN_TEXT_SIZE];
+  formatPattern(pattern, buffer, sizeof(buffer));
+  return String(buffer);
+}
 
-  return newPattern;
+inline PatternDescription stringToPattern(const String& value) {
+  PatternDescription result;
+  parsePattern(value.c_str(), &result);
+  return result;
 }
 
 #endif
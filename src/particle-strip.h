@@ -22,12 +22,23 @@
 
 // Include all the headers provided by this library.
 #include "ParticleStrip/color.h"
+#include "ParticleStrip/output.h"
+#include "ParticleStrip/palette.h"
 #include "ParticleStrip/strip.h"
+#include "ParticleStrip/gpio-port.h"
+#include "ParticleStrip/spi-output.h"
 #include "ParticleStrip/digital-strip.h"
 #include "ParticleStrip/dot-strip.h"
 #include "ParticleStrip/neo-strip.h"
+#include "ParticleStrip/neo-spi-strip.h"
+#include "ParticleStrip/parallel-neo-strips.h"
 #include "ParticleStrip/led-strip.h"
+#include "ParticleStrip/frame-strip.h"
 #include "ParticleStrip/patterns.h"
+#include "ParticleStrip/crossfade.h"
+#include "ParticleStrip/compositor.h"
+#include "ParticleStrip/scheduler.h"
+#include "ParticleStrip/render-thread.h"
 #include "ParticleStrip/text.h"
 
 //